@@ -79,6 +79,8 @@ shared_ptr<AnalyzerNode> Analyzer::analyzeForm(const shared_ptr<ASTNode>& form)
         break;
     case kTypeTagKeyword:node = analyzeKeyword(form);
         break;
+    case kTypeTagChar:node = analyzeChar(form);
+        break;
     case kTypeTagSymbol:node = analyzeSymbol(form);
         break;
     case kTypeTagList:node = analyzeList(form);
@@ -368,6 +370,15 @@ shared_ptr<AnalyzerNode> Analyzer::analyzeKeyword(const shared_ptr<ASTNode>& for
     return node;
 }
 
+shared_ptr<AnalyzerNode> Analyzer::analyzeChar(const shared_ptr<ASTNode>& form) {
+    auto node = make_shared<ConstantValueAnalyzerNode>();
+    node->type           = kAnalyzerConstantTypeChar;
+    node->value          = form->integerValue;
+    node->sourcePosition = form->sourcePosition;
+    node->ns             = current_ns_;
+    return node;
+}
+
 shared_ptr<AnalyzerNode> Analyzer::analyzeList(const shared_ptr<ASTNode>& form) {
     auto listPtr  = form->listValue;
     auto listSize = listPtr->size();
@@ -892,27 +903,31 @@ shared_ptr<AnalyzerNode> Analyzer::analyzeDefFFIFn(const shared_ptr<ASTNode>& fo
                 listPtr->at(3)->sourcePosition);
     }
 
-    if (listPtr->at(4)->tag != kTypeTagList) {
+    // An empty argument list reads as nil
+    if (listPtr->at(4)->tag != kTypeTagList && listPtr->at(4)->tag != kTypeTagNil) {
         throw CompilerException("def-ffi-fn* argument types must be a list",
                 listPtr->at(4)->sourcePosition);
     }
-    auto arg_types = listPtr->at(4)->listValue;
 
     vector<FFIType> args;
-    args.reserve(arg_types->size());
 
-    for (const auto& argPtr: *arg_types) {
-        if (argPtr->tag != kTypeTagKeyword) {
-            throw CompilerException("def-ffi-fn* arg type must be a keyword",
-                    argPtr->sourcePosition);
-        }
+    if (listPtr->at(4)->tag == kTypeTagList) {
+        auto arg_types = listPtr->at(4)->listValue;
+        args.reserve(arg_types->size());
 
-        auto argType = ffi_type_from_keyword(*argPtr->stringValue);
-        if (argType == kFFITypeUnknown) {
-            throw CompilerException("Unknown FFI type",
-                    argPtr->sourcePosition);
+        for (const auto& argPtr: *arg_types) {
+            if (argPtr->tag != kTypeTagKeyword) {
+                throw CompilerException("def-ffi-fn* arg type must be a keyword",
+                        argPtr->sourcePosition);
+            }
+
+            auto argType = ffi_type_from_keyword(*argPtr->stringValue);
+            if (argType == kFFITypeUnknown) {
+                throw CompilerException("Unknown FFI type",
+                        argPtr->sourcePosition);
+            }
+            args.push_back(argType);
         }
-        args.push_back(argType);
     }
 
     auto node = make_shared<DefFFIFunctionNode>();
@@ -145,6 +145,7 @@ enum AnalyzerConstantType {
   kAnalyzerConstantTypeString,
   kAnalyzerConstantTypeSymbol,
   kAnalyzerConstantTypeKeyword,
+  kAnalyzerConstantTypeChar,
   kAnalyzerConstantTypeNil
 };
 
@@ -175,6 +176,7 @@ public:
         case kAnalyzerConstantTypeInteger: return "integer";
         case kAnalyzerConstantTypeKeyword: return "keyword";
         case kAnalyzerConstantTypeString: return "string";
+        case kAnalyzerConstantTypeChar: return "char";
         }
 
         return "";
@@ -200,6 +202,8 @@ public:
             break;
         case kAnalyzerConstantTypeString: node["value"] = *boost::get<shared_ptr<string>>(value);
             break;
+        case kAnalyzerConstantTypeChar: node["value"] = boost::get<int64_t>(value);
+            break;
         }
         return node;
     }
@@ -813,6 +817,7 @@ private:
     shared_ptr<AnalyzerNode> analyzeString(const shared_ptr<ASTNode>& form);
     shared_ptr<AnalyzerNode> analyzeNil(const shared_ptr<ASTNode>& form);
     shared_ptr<AnalyzerNode> analyzeKeyword(const shared_ptr<ASTNode>& form);
+    shared_ptr<AnalyzerNode> analyzeChar(const shared_ptr<ASTNode>& form);
     shared_ptr<AnalyzerNode> analyzeBoolean(const shared_ptr<ASTNode>& form);
     shared_ptr<AnalyzerNode> analyzeList(const shared_ptr<ASTNode>& form);
     shared_ptr<AnalyzerNode> analyzeIf(const shared_ptr<ASTNode>& form);
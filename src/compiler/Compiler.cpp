@@ -33,6 +33,7 @@
 #include <utility>
 
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/CodeGen/GCStrategy.h>
 #include <llvm/CodeGen/BuiltinGCs.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
@@ -50,12 +51,13 @@ namespace electrum {
 
 #pragma mark - Compiler
 
-Compiler::Compiler() {
+Compiler::Compiler(std::shared_ptr<GCRootStrategy> root_strategy)
+        :root_strategy_(std::move(root_strategy)) {
     llvm::InitializeNativeTarget();
     llvm::InitializeNativeTargetAsmPrinter();
     llvm::InitializeNativeTargetAsmParser();
     llvm::linkAllBuiltinGCs();
-    jit_ = std::make_shared<ElectrumJit>(es_);
+    jit_ = std::make_shared<ElectrumJit>(es_, root_strategy_);
 }
 
 boost::filesystem::path tempPath() {
@@ -87,7 +89,6 @@ void* Compiler::compileAndEvalString(const std::string& str) {
     temp_path.remove_filename();
 
     currentContext()->pushNewState("jit_module", temp_path.string() + "/", fname.string());
-    createGCEntry();
 
     // Analyze as a top level form
     auto node           = analyzer_.analyze(ast, 0);
@@ -123,7 +124,7 @@ TopLevelInitializerDef Compiler::compileTopLevelNode(std::shared_ptr<AnalyzerNod
             mangled_name,
             currentContext()->currentModule());
 
-    mainfunc->setGC("statepoint-example");
+    root_strategy_->prepareFunction(mainfunc);
 
     /* Function Debug Info */
     llvm::DIScope* f_ctx = currentContext()->currentDebugInfo()->currentScope();
@@ -151,6 +152,7 @@ TopLevelInitializerDef Compiler::compileTopLevelNode(std::shared_ptr<AnalyzerNod
     auto entry = llvm::BasicBlock::Create(llvmContext(), "entry", mainfunc);
 
     currentBuilder()->SetInsertPoint(entry);
+    buildSafepointPoll(*currentBuilder());
     compileNode(std::move(node));
 
     // Return result.
@@ -181,12 +183,13 @@ void* Compiler::runInitializerWithJit(TopLevelInitializerDef& tl_def) {
         std::stringstream ss;
         ss << "jit_module__" << cnt;
         currentContext()->pushNewState(ss.str(), "/tmp", "tl.el");
-        createGCEntry();
     }
 
     auto f_addr = jit_->getSymbolAddress(tl_def.mangled_name);
     typedef void* (* InitFunc)();
     auto f_ptr = reinterpret_cast<InitFunc>(f_addr);
+
+    RootStackScope root_scope;
     return f_ptr();
 }
 
@@ -203,9 +206,6 @@ void* Compiler::compileAndEvalExpander(std::shared_ptr<MacroExpandAnalyzerNode>
     auto b = currentContext()->local_bindings;
     currentContext()->pushNewState(moduless.str(), filename.string(), temp_path.string());
 
-
-    createGCEntry();
-
     std::stringstream ss;
     ss << "expansion_func_" << cnt;
 
@@ -215,7 +215,7 @@ void* Compiler::compileAndEvalExpander(std::shared_ptr<MacroExpandAnalyzerNode>
             ss.str(),
             currentContext()->currentModule());
 
-    mainfunc->setGC("statepoint-example");
+    root_strategy_->prepareFunction(mainfunc);
 
     /* Function Debug Info */
 
@@ -261,6 +261,8 @@ void* Compiler::compileAndEvalExpander(std::shared_ptr<MacroExpandAnalyzerNode>
     typedef void* (* MainPtr)();
 
     auto fp = reinterpret_cast<MainPtr>(faddr);
+
+    RootStackScope root_scope;
     auto rv = fp();
 
     ++cnt;
@@ -268,24 +270,6 @@ void* Compiler::compileAndEvalExpander(std::shared_ptr<MacroExpandAnalyzerNode>
     return rv;
 }
 
-void Compiler::createGCEntry() {
-    auto gc_type = llvm::FunctionType::get(llvm::Type::getVoidTy(currentContext()->llvmContext()), false);
-    auto gcfunc  = llvm::dyn_cast<llvm::Function>(
-            currentContext()->currentModule()->getOrInsertFunction("gc.safepoint_poll", gc_type));
-
-    gcfunc->addFnAttr(llvm::Attribute::NoUnwind);
-
-    auto              gc_entry = llvm::BasicBlock::Create(currentContext()->llvmContext(), "entry", gcfunc);
-    llvm::IRBuilder<> b(currentContext()->llvmContext());
-    b.SetInsertPoint(gc_entry);
-
-    auto dogc = currentContext()->currentModule()->getOrInsertFunction("rt_enter_gc",
-            llvm::Type::getVoidTy(currentContext()
-                    ->llvmContext()));
-    b.CreateCall(dogc);
-    b.CreateRet(nullptr);
-}
-
 void Compiler::compileNode(std::shared_ptr<AnalyzerNode> node) {
     currentContext()->emitLocation(node->sourcePosition);
 
@@ -369,6 +353,8 @@ void Compiler::compileConstant(std::shared_ptr<ConstantValueAnalyzerNode> node)
         break;
     case kAnalyzerConstantTypeKeyword: v = makeKeyword(boost::get<shared_ptr<std::string>>(node->value));
         break;
+    case kAnalyzerConstantTypeChar: v = makeImmediate(rt_make_char(static_cast<uint32_t>(boost::get<int64_t>(node->value))));
+        break;
     default:throw CompilerException("Unrecognized constant type", node->sourcePosition);
     }
 
@@ -517,7 +503,7 @@ void Compiler::compileLambda(const std::shared_ptr<LambdaAnalyzerNode>& node) {
             ss.str(),
             currentModule());
 
-    lambda->setGC("statepoint-example");
+    root_strategy_->prepareFunction(lambda);
 
     /* Function Debug Info */
 
@@ -621,6 +607,8 @@ void Compiler::compileLambda(const std::shared_ptr<LambdaAnalyzerNode>& node) {
     currentContext()->pushLocalEnvironment(local_env);
     currentContext()->pushFunc(lambda);
 
+    buildSafepointPoll(*currentBuilder());
+
     // Compile the body of the function
     compileNode(node->body);
     currentBuilder()->CreateRet(currentContext()->popValue());
@@ -713,8 +701,9 @@ void Compiler::compileMaybeInvoke(const std::shared_ptr<MaybeInvokeAnalyzerNode>
     compileNode(list_node);
     auto args = currentContext()->popValue();
 
-    // TODO: Is there a better way to save the args?
-    buildGcAddRoot(args);
+    // Keep the args alive for the duration of the call
+    auto saved_roots = buildGcSaveRootStack();
+    buildGcPushRoot(args);
 
     auto eh_info = currentContext()->currentScope()->currentEHInfo();
     if (eh_info != nullptr) {
@@ -723,7 +712,7 @@ void Compiler::compileMaybeInvoke(const std::shared_ptr<MaybeInvokeAnalyzerNode>
     else {
         currentContext()->pushValue(buildApply(fn, args));
     }
-    buildGcRemoveRoot(args);
+    buildGcRestoreRootStack(saved_roots);
 
 //    std::vector<llvm::Value *> args;
 //    args.reserve(node->args.size() + 1);
@@ -785,7 +774,7 @@ void Compiler::compileDefFFIFn(const std::shared_ptr<electrum::DefFFIFunctionNod
             mangleSymbolName("", mangled_name),
             currentModule());
 
-    ffi_wrapper->setGC("statepoint-example");
+    root_strategy_->prepareFunction(ffi_wrapper);
 
     llvm::DIScope* f_ctx = currentContext()->currentDebugInfo()->currentScope();
     auto unit = currentContext()->currentDIBuilder()->createFile(
@@ -899,7 +888,7 @@ void Compiler::compileDefMacro(const std::shared_ptr<electrum::DefMacroAnalyzerN
             ss.str(),
             currentModule());
 
-    expander->setGC("statepoint-example");
+    root_strategy_->prepareFunction(expander);
 
     /* Function Debug Info */
 
@@ -1142,6 +1131,9 @@ void Compiler::compileTry(const shared_ptr<TryAnalyzerNode>& node) {
     auto rv = currentBuilder()->CreateAlloca(llvm::IntegerType::getInt8PtrTy(llvmContext(), kGCAddressSpace),
             0, nullptr, "exc_rv");
 
+    // Roots pushed by calls that throw are popped when the exception is caught
+    auto saved_roots = buildGcSaveRootStack();
+
     // Block that will contain all of the landing pads
     auto catch_block = llvm::BasicBlock::Create(llvmContext(), "catch", currentContext()->currentFunc());
 
@@ -1176,6 +1168,7 @@ void Compiler::compileTry(const shared_ptr<TryAnalyzerNode>& node) {
             false);
     auto landing_pad    = currentBuilder()->CreateLandingPad(lp_type, node->catch_nodes.size());
     auto exception_type = currentBuilder()->CreateExtractValue(landing_pad, 0);
+    buildGcRestoreRootStack(saved_roots);
 
     auto e_eq = currentModule()->getOrInsertFunction("el_rt_exception_matches",
             llvm::IntegerType::getInt64Ty(llvmContext()),
@@ -1341,6 +1334,9 @@ void Compiler::compileWhile(const shared_ptr<WhileAnalyzerNode>& node) {
     }
 
     currentBuilder()->CreateStore(rv, result);
+
+    // Poll on the back-edge, so long running loops can be collected
+    buildSafepointPoll(*currentBuilder());
     currentBuilder()->CreateBr(cond_block);
 
     currentBuilder()->SetInsertPoint(end_block);
@@ -1377,7 +1373,24 @@ llvm::Value* Compiler::makeInteger(int64_t value) {
                     value)});
 }
 
+/**
+ * @return A constant for a tagged value that is not heap allocated
+ */
+llvm::Value* Compiler::makeImmediate(void* value) {
+    auto bits = llvm::ConstantInt::get(llvm::IntegerType::getInt64Ty(llvmContext()),
+            reinterpret_cast<uint64_t>(value));
+
+    return llvm::ConstantExpr::getIntToPtr(bits,
+            llvm::IntegerType::getInt8PtrTy(llvmContext(), kGCAddressSpace));
+}
+
 llvm::Value* Compiler::makeFloat(double value) {
+    // Most floats are immediates, which are constants needing no allocation
+    void* immediate;
+    if (electrum::float_to_immediate(value, &immediate)) {
+        return makeImmediate(immediate);
+    }
+
     auto func = currentModule()->getOrInsertFunction("rt_make_float",
             llvm::IntegerType::getInt8PtrTy(llvmContext(),
                     kGCAddressSpace),
@@ -1401,6 +1414,11 @@ llvm::Value* Compiler::makeBoolean(bool value) {
 }
 
 llvm::Value* Compiler::makeSymbol(std::shared_ptr<std::string> name) {
+    // Short names are immediates
+    if (name->size() <= electrum::kShortNameMaxLength) {
+        return makeImmediate(electrum::make_short_name(SHORT_SYMBOL_TAG, name->data(), name->size()));
+    }
+
     auto func = currentModule()->getOrInsertFunction("rt_make_symbol",
             llvm::IntegerType::getInt8PtrTy(llvmContext(),
                     kGCAddressSpace),
@@ -1411,6 +1429,10 @@ llvm::Value* Compiler::makeSymbol(std::shared_ptr<std::string> name) {
 }
 
 llvm::Value* Compiler::makeString(std::shared_ptr<std::string> str) {
+    if (str->size() <= electrum::kShortNameMaxLength) {
+        return makeImmediate(electrum::make_short_name(SHORT_STRING_TAG, str->data(), str->size()));
+    }
+
     auto func = currentModule()->getOrInsertFunction("rt_make_string",
             llvm::IntegerType::getInt8PtrTy(llvmContext(),
                     kGCAddressSpace),
@@ -1421,6 +1443,10 @@ llvm::Value* Compiler::makeString(std::shared_ptr<std::string> str) {
 }
 
 llvm::Value* Compiler::makeKeyword(std::shared_ptr<std::string> name) {
+    if (name->size() <= electrum::kShortNameMaxLength) {
+        return makeImmediate(electrum::make_short_name(SHORT_SYMBOL_TAG | SHORT_KEYWORD_BIT, name->data(), name->size()));
+    }
+
     auto func = currentModule()->getOrInsertFunction("rt_make_keyword",
             llvm::IntegerType::getInt8PtrTy(llvmContext(),
                     kGCAddressSpace),
@@ -1558,6 +1584,89 @@ llvm::Value* Compiler::buildGcRemoveRoot(llvm::Value* obj) {
     return currentBuilder()->CreateCall(func, {obj});
 }
 
+/**
+ * @return The current top of the root stack, to be passed to buildGcRestoreRootStack
+ */
+llvm::Value* Compiler::buildGcSaveRootStack() {
+    auto top_type = llvm::PointerType::get(llvm::IntegerType::getInt8PtrTy(llvmContext(), kGCAddressSpace), 0);
+    auto top_ref  = currentModule()->getOrInsertGlobal("rt_gc_root_stack_top", top_type);
+
+    return currentBuilder()->CreateLoad(top_ref, "saved_roots");
+}
+
+/**
+ * Pop every root pushed since the root stack top was saved
+ */
+void Compiler::buildGcRestoreRootStack(llvm::Value* saved_top) {
+    auto top_type = llvm::PointerType::get(llvm::IntegerType::getInt8PtrTy(llvmContext(), kGCAddressSpace), 0);
+    auto top_ref  = currentModule()->getOrInsertGlobal("rt_gc_root_stack_top", top_type);
+
+    currentBuilder()->CreateStore(saved_top, top_ref);
+}
+
+/**
+ * Push a root onto the root stack. This is a store and a pointer bump,
+ * with a cold call out if the stack is full.
+ */
+void Compiler::buildGcPushRoot(llvm::Value* obj) {
+    auto top_type  = llvm::PointerType::get(llvm::IntegerType::getInt8PtrTy(llvmContext(), kGCAddressSpace), 0);
+    auto top_ref   = currentModule()->getOrInsertGlobal("rt_gc_root_stack_top", top_type);
+    auto limit_ref = currentModule()->getOrInsertGlobal("rt_gc_root_stack_limit", top_type);
+
+    auto top   = currentBuilder()->CreateLoad(top_ref, "root_stack_top");
+    auto limit = currentBuilder()->CreateLoad(limit_ref, "root_stack_limit");
+    auto full  = currentBuilder()->CreateICmpEQ(top, limit);
+
+    auto overflow_block = llvm::BasicBlock::Create(llvmContext(), "root_stack_overflow", currentContext()->currentFunc());
+    auto push_block     = llvm::BasicBlock::Create(llvmContext(), "root_stack_push", currentContext()->currentFunc());
+
+    llvm::MDBuilder md_builder(llvmContext());
+    currentBuilder()->CreateCondBr(full, overflow_block, push_block, md_builder.createBranchWeights(1, 100000));
+
+    currentBuilder()->SetInsertPoint(overflow_block);
+    auto overflow = currentModule()->getOrInsertFunction("rt_gc_root_stack_overflow",
+            llvm::Type::getVoidTy(llvmContext()));
+    currentBuilder()->CreateCall(overflow);
+    currentBuilder()->CreateUnreachable();
+
+    currentBuilder()->SetInsertPoint(push_block);
+    currentBuilder()->CreateStore(obj, top);
+    currentBuilder()->CreateStore(currentBuilder()->CreateConstGEP1_64(top, 1), top_ref);
+}
+
+/**
+ * Emit an inline safepoint poll at the builder's insert point. The fast
+ * path is a load and compare of rt_gc_requested; the call into the
+ * collector is kept in a cold block.
+ */
+void Compiler::buildSafepointPoll(llvm::IRBuilder<>& builder) {
+    auto& context = builder.getContext();
+    auto  module  = builder.GetInsertBlock()->getModule();
+    auto  func    = builder.GetInsertBlock()->getParent();
+
+    auto flag_type = llvm::Type::getInt8Ty(context);
+    auto flag_ref  = module->getOrInsertGlobal("rt_gc_requested", flag_type);
+
+    // Volatile, so the poll is not hoisted out of loops
+    auto flag = builder.CreateLoad(flag_ref, "gc_requested");
+    flag->setVolatile(true);
+
+    auto requested = builder.CreateICmpNE(flag, llvm::ConstantInt::get(flag_type, 0));
+
+    auto collect_block = llvm::BasicBlock::Create(context, "gc_poll_collect", func);
+    auto cont_block    = llvm::BasicBlock::Create(context, "gc_poll_cont", func);
+
+    llvm::MDBuilder md_builder(context);
+    builder.CreateCondBr(requested, collect_block, cont_block, md_builder.createBranchWeights(1, 100000));
+
+    builder.SetInsertPoint(collect_block);
+    auto enter_gc = module->getOrInsertFunction("rt_enter_gc", llvm::Type::getVoidTy(context));
+    builder.CreateCall(enter_gc);
+    builder.CreateBr(cont_block);
+
+    builder.SetInsertPoint(cont_block);
+}
+
 llvm::Value* Compiler::buildApply(llvm::Value* f, llvm::Value* args) {
     auto func = currentModule()->getOrInsertFunction("rt_apply",
             llvm::Type::getInt8PtrTy(llvmContext(), kGCAddressSpace),
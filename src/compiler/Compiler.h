@@ -32,6 +32,7 @@
 #include "Analyzer.h"
 #include "ElectrumJit.h"
 #include "CompilerContext.h"
+#include "GCRootStrategy.h"
 
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Value.h>
@@ -42,7 +43,8 @@ namespace electrum {
 class Compiler {
 
 public:
-    Compiler();
+    /** @param root_strategy How compiled code makes its GC roots visible to the collector */
+    explicit Compiler(std::shared_ptr<GCRootStrategy> root_strategy = std::make_shared<StackMapRootStrategy>());
 
     void* compileAndEvalString(const std::string& str);
     void* compileAndEvalExpander(std::shared_ptr<MacroExpandAnalyzerNode> node);
@@ -53,9 +55,10 @@ private:
     CompilerContext              compiler_context_;
     Analyzer                     analyzer_;
     std::shared_ptr<ElectrumJit> jit_;
+    std::shared_ptr<GCRootStrategy> root_strategy_;
 
     /// Address space for the garbage collector
-    static const int kGCAddressSpace = 1;
+    static const int kGCAddressSpace = kGCPointerAddressSpace;
 
     CompilerContext* currentContext() { return &compiler_context_; }
     llvm::Module* currentModule() { return currentContext()->currentModule(); }
@@ -84,12 +87,11 @@ private:
 
     std::string mangleSymbolName(std::string ns, const std::string& name);
 
-    void createGCEntry();
-
     /* Standard library helpers */
     llvm::Value* makeNil();
     llvm::Value* makeInteger(int64_t value);
     llvm::Value* makeFloat(double value);
+    llvm::Value* makeImmediate(void* value);
     llvm::Value* makeBoolean(bool value);
     llvm::Value* makeSymbol(std::shared_ptr<std::string> name);
     llvm::Value* makeString(std::shared_ptr<std::string> str);
@@ -105,6 +107,10 @@ private:
     llvm::Value* buildLambdaGetEnv(llvm::Value* fn, uint64_t idx);
     llvm::Value* buildGcAddRoot(llvm::Value* obj);
     llvm::Value* buildGcRemoveRoot(llvm::Value* obj);
+    llvm::Value* buildGcSaveRootStack();
+    void buildGcRestoreRootStack(llvm::Value* saved_top);
+    void buildGcPushRoot(llvm::Value* obj);
+    void buildSafepointPoll(llvm::IRBuilder<>& builder);
     llvm::Value* buildApply(llvm::Value* f, llvm::Value* args);
     llvm::Value* buildApplyInvoke(llvm::Value* f, llvm::Value* args, shared_ptr<EHCompileInfo> eh_info);
 
@@ -23,39 +23,53 @@
 */
 
 #include "ElectrumJit.h"
+#include <runtime/GarbageCollector.h>
 #include <memory>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Object/SymbolSize.h>
 #include <iostream>
 
 namespace electrum {
 
-static std::unique_ptr<llvm::Module> optimize_module(std::unique_ptr<llvm::Module> module) {
-    auto fpm                 = std::make_unique<llvm::legacy::FunctionPassManager>(module.get());
-
-//    fpm->add(llvm::createPlaceSafepointsPass());
-    fpm->doInitialization();
-
+/**
+ * Optimize a module, then lower its GC roots with the root strategy. The
+ * optimizer runs first, while GC pointers are plain address space 1
+ * values, so it can move them freely. With the stack map strategy,
+ * RewriteStatepointsForGC then turns every call into a statepoint that
+ * records the live GC pointers, with a base pointer for each derived
+ * pointer, and relocates them across the call. The stack map emitted from
+ * these becomes the frame_info_t slots that the collector walks.
+ *
+ * Safepoint polls are emitted inline by the front end at function entries
+ * and loop back-edges, so PlaceSafepoints is not needed to insert them.
+ */
+static std::unique_ptr<llvm::Module> optimize_module(std::unique_ptr<llvm::Module> module,
+                                                     const GCRootStrategy& root_strategy) {
+    llvm::PassManagerBuilder builder;
+    builder.OptLevel  = 3;
+    builder.SizeLevel = 0;
+    builder.Inliner   = llvm::createFunctionInliningPass(builder.OptLevel, builder.SizeLevel, false);
+
+    llvm::legacy::FunctionPassManager fpm(module.get());
+    builder.populateFunctionPassManager(fpm);
+
+    fpm.doInitialization();
     for (auto& f: *module) {
-        fpm->run(f);
+        fpm.run(f);
     }
+    fpm.doFinalization();
 
-//    auto error_stream = llvm::raw_string_ostream(errors);
-//    auto has_errors = llvm::verifyModule(*module, &error_stream, nullptr);
-//    if (has_errors) {
-//        error_stream.flush();
-//        std::cout << errors << std::endl;
-//        module->print(llvm::errs(), nullptr);
-//        throw std::exception();
-//    }
+    llvm::legacy::PassManager mpm;
+    builder.populateModulePassManager(mpm);
 
-//    module->print(llvm::errs(), nullptr);
-
-    /*llvm::legacy::PassManager pm;
-    pm.add(llvm::createRewriteStatepointsForGCLegacyPass());
-    pm.run(*module);
-     */
+    // Lowering has to follow every IR optimization, or a GC pointer could
+    // be kept live across a call without the collector knowing about it
+    root_strategy.addLoweringPasses(mpm);
+    mpm.run(*module);
 
     std::string errors;
     auto        error_stream = llvm::raw_string_ostream(errors);
@@ -71,7 +85,7 @@ static std::unique_ptr<llvm::Module> optimize_module(std::unique_ptr<llvm::Modul
     return module;
 }
 
-ElectrumJit::ElectrumJit(llvm::orc::ExecutionSession& es)
+ElectrumJit::ElectrumJit(llvm::orc::ExecutionSession& es, std::shared_ptr<GCRootStrategy> root_strategy)
         :es_(es),
          resolver_(createLegacyLookupResolver(
                  es_,
@@ -103,10 +117,9 @@ ElectrumJit::ElectrumJit(llvm::orc::ExecutionSession& es)
                  },
 
                  // Notify Loaded
-                 [this](llvm::orc::VModuleKey, const llvm::object::ObjectFile& obj,
+                 [this](llvm::orc::VModuleKey k, const llvm::object::ObjectFile& obj,
                          const llvm::RuntimeDyld::LoadedObjectInfo& info) {
-                   //this->gdb_listener_->notifyObjectLoaded();
-                   //NotifyObjectEmitted(obj, info);
+                   registerFunctions(k, obj, info);
                  },
                  [this](llvm::orc::VModuleKey, const llvm::object::ObjectFile& obj,
                          const llvm::RuntimeDyld::LoadedObjectInfo& info) {
@@ -116,9 +129,10 @@ ElectrumJit::ElectrumJit(llvm::orc::ExecutionSession& es)
                  }),
          compile_layer_(object_layer_, llvm::orc::SimpleCompiler(*target_machine_)),
          optimize_layer_(compile_layer_, [this](std::unique_ptr<llvm::Module> M) {
-           return optimize_module(std::move(M));
+           return optimize_module(std::move(M), *root_strategy_);
          }),
-         stack_map_ptr_(nullptr) {
+         stack_map_ptr_(nullptr),
+         root_strategy_(std::move(root_strategy)) {
     llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
 
     object_layer_.setProcessAllSections(true);
@@ -131,7 +145,13 @@ llvm::orc::VModuleKey ElectrumJit::addModule(std::unique_ptr<llvm::Module> modul
     auto k = es_.allocateVModule();
     llvm::cantFail(optimize_layer_.addModule(k, std::move(module)));
 
+    // Only report a stackmap if this module emitted one
+    stack_map_ptr_ = nullptr;
     auto error = optimize_layer_.emitAndFinalize(k);
+
+    if (stack_map_ptr_ != nullptr) {
+        module_stack_maps_[k] = stack_map_ptr_;
+    }
     return k;
 }
 
@@ -146,7 +166,56 @@ llvm::JITTargetAddress ElectrumJit::getSymbolAddress(const std::string& name) {
     return llvm::cantFail(findSymbol(name).getAddress());
 }
 
+/**
+ * Tell the allocation profiler where each function of a loaded object is,
+ * so it can name the call sites of its allocations
+ */
+void ElectrumJit::registerFunctions(llvm::orc::VModuleKey key, const llvm::object::ObjectFile& obj,
+                                    const llvm::RuntimeDyld::LoadedObjectInfo& info) {
+    auto& functions = module_functions_[key];
+
+    for (auto& symbol_size: llvm::object::computeSymbolSizes(obj)) {
+        auto& symbol = symbol_size.first;
+
+        auto type = symbol.getType();
+        if (!type || *type != llvm::object::SymbolRef::ST_Function) {
+            llvm::consumeError(type.takeError());
+            continue;
+        }
+
+        auto name    = symbol.getName();
+        auto address = symbol.getAddress();
+        auto section = symbol.getSection();
+        if (!name || !address || !section || *section == obj.section_end()) {
+            llvm::consumeError(name.takeError());
+            llvm::consumeError(address.takeError());
+            llvm::consumeError(section.takeError());
+            continue;
+        }
+
+        // Symbol addresses are relative to their section until it is loaded
+        auto start = info.getSectionLoadAddress(**section) + *address - (*section)->getAddress();
+        rt_gc_register_code(name->str().c_str(), start, symbol_size.second);
+        functions.push_back(start);
+    }
+}
+
 void ElectrumJit::removeModule(llvm::orc::VModuleKey h) {
+    // The stackmap lives in the module's memory, so it must go first
+    auto stack_map = module_stack_maps_.find(h);
+    if (stack_map != module_stack_maps_.end()) {
+        rt_gc_remove_stackmap(stack_map->second);
+        module_stack_maps_.erase(stack_map);
+    }
+
+    auto functions = module_functions_.find(h);
+    if (functions != module_functions_.end()) {
+        for (auto start: functions->second) {
+            rt_gc_remove_code(start);
+        }
+        module_functions_.erase(functions);
+    }
+
     llvm::cantFail(optimize_layer_.removeModule(h));
 }
 
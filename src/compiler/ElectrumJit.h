@@ -45,10 +45,12 @@
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Target/TargetMachine.h>
 #include <algorithm>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 #include "JitMemoryManager.h"
+#include "GCRootStrategy.h"
 
 namespace electrum {
 
@@ -74,13 +76,23 @@ private:
     llvm::orc::JITCompileCallbackManager* compile_callback_mgr_;
     std::unique_ptr<llvm::orc::IndirectStubsManager> indirect_stubs_mgr_;
     void* stack_map_ptr_;
+    std::shared_ptr<GCRootStrategy> root_strategy_;
+
+    /** Stackmap section of each module that has one, to unregister it on removal */
+    std::map<llvm::orc::VModuleKey, void*> module_stack_maps_;
+
+    /** Start addresses of each module's functions, as named for the allocation profiler */
+    std::map<llvm::orc::VModuleKey, std::vector<uint64_t>> module_functions_;
 
     llvm::JITEventListener *gdb_listener_;
 
+    void registerFunctions(llvm::orc::VModuleKey key, const llvm::object::ObjectFile& obj,
+                           const llvm::RuntimeDyld::LoadedObjectInfo& info);
+
 public:
     using MyRemote = llvm::orc::remote::OrcRemoteTargetClient;
 
-    ElectrumJit(llvm::orc::ExecutionSession& es);
+    ElectrumJit(llvm::orc::ExecutionSession& es, std::shared_ptr<GCRootStrategy> root_strategy);
 
     llvm::TargetMachine& getTargetMachine();
 
@@ -0,0 +1,190 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "GCRootStrategy.h"
+#include <vector>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Pass.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+
+namespace electrum {
+
+#pragma mark - Stack maps
+
+void StackMapRootStrategy::prepareFunction(llvm::Function* func) const {
+    func->setGC("statepoint-example");
+}
+
+void StackMapRootStrategy::addLoweringPasses(llvm::legacy::PassManager& pm) const {
+    pm.add(llvm::createRewriteStatepointsForGCLegacyPass());
+}
+
+#pragma mark - Shadow stack
+
+/** Marks the functions created by the compiler, which are the only ones given a frame */
+static const char* kShadowStackAttribute = "electrum-shadow-stack";
+
+static bool isGCPointer(llvm::Type* type) {
+    return type->isPointerTy() && type->getPointerAddressSpace() == kGCPointerAddressSpace;
+}
+
+/**
+ * Gives every function created by the compiler a frame on the root stack,
+ * holding each GC pointer the function produces. A value keeps its slot for the whole function,
+ * so the frame has a fixed size and loops don't grow it.
+ */
+class ShadowStackLowering : public llvm::FunctionPass {
+public:
+    static char ID;
+
+    ShadowStackLowering() :llvm::FunctionPass(ID) {}
+
+    llvm::StringRef getPassName() const override { return "Electrum shadow stack lowering"; }
+
+    bool runOnFunction(llvm::Function& func) override;
+};
+
+char ShadowStackLowering::ID = 0;
+
+bool ShadowStackLowering::runOnFunction(llvm::Function& func) {
+    if (func.isDeclaration() || !func.hasFnAttribute(kShadowStackAttribute)) {
+        return false;
+    }
+
+    // Arguments come first, so their slots can be filled on entry
+    std::vector<llvm::Value*>       roots;
+    std::vector<llvm::Instruction*> exits;
+
+    for (auto& arg: func.args()) {
+        if (isGCPointer(arg.getType())) {
+            roots.push_back(&arg);
+        }
+    }
+
+    for (auto& block: func) {
+        for (auto& inst: block) {
+            // A phi or select may be the only holder of a value whose own
+            // slot has since been refilled, such as a loop carried result
+            auto produces_root = llvm::isa<llvm::CallInst>(inst)
+                                 || llvm::isa<llvm::InvokeInst>(inst)
+                                 || llvm::isa<llvm::LoadInst>(inst)
+                                 || llvm::isa<llvm::PHINode>(inst)
+                                 || llvm::isa<llvm::SelectInst>(inst);
+
+            if (produces_root && isGCPointer(inst.getType())) {
+                roots.push_back(&inst);
+            }
+            else if (llvm::isa<llvm::ReturnInst>(inst) || llvm::isa<llvm::ResumeInst>(inst)) {
+                exits.push_back(&inst);
+            }
+        }
+    }
+
+    if (roots.empty()) {
+        return false;
+    }
+
+    auto  module    = func.getParent();
+    auto& context   = func.getContext();
+    auto  slot_type = llvm::Type::getInt8PtrTy(context, kGCPointerAddressSpace);
+    auto  top_type  = llvm::PointerType::get(slot_type, 0);
+    auto  top_ref   = module->getOrInsertGlobal("rt_gc_root_stack_top", top_type);
+    auto  limit_ref = module->getOrInsertGlobal("rt_gc_root_stack_limit", top_type);
+
+    // Push the frame after the static allocas, so they stay in the entry block
+    auto& entry        = func.getEntryBlock();
+    auto  split_before = &*entry.getFirstInsertionPt();
+    while (llvm::isa<llvm::AllocaInst>(split_before)) {
+        split_before = split_before->getNextNode();
+    }
+
+    llvm::IRBuilder<> builder(split_before);
+    auto frame     = builder.CreateLoad(top_ref, "shadow_frame");
+    auto frame_end = builder.CreateConstGEP1_64(frame, roots.size(), "shadow_frame_end");
+    auto limit     = builder.CreateLoad(limit_ref, "root_stack_limit");
+    auto full      = builder.CreateICmpUGT(frame_end, limit);
+
+    llvm::MDBuilder md_builder(context);
+    auto overflow_term = llvm::SplitBlockAndInsertIfThen(full, split_before, true, md_builder.createBranchWeights(1, 100000));
+
+    builder.SetInsertPoint(overflow_term);
+    auto overflow = module->getOrInsertFunction("rt_gc_root_stack_overflow", llvm::Type::getVoidTy(context));
+    builder.CreateCall(overflow);
+
+    // Clear the frame before publishing it, so the collector never sees
+    // stale values in slots that have not been filled yet
+    builder.SetInsertPoint(split_before);
+    builder.CreateMemSet(frame, builder.getInt8(0), roots.size() * sizeof(void*), sizeof(void*));
+    builder.CreateStore(frame_end, top_ref);
+
+    for (size_t i = 0; i < roots.size(); i++) {
+        auto inst = llvm::dyn_cast<llvm::Instruction>(roots[i]);
+
+        if (inst == nullptr) {
+            builder.SetInsertPoint(split_before);
+        }
+        else if (auto invoke = llvm::dyn_cast<llvm::InvokeInst>(inst)) {
+            // The result only exists on the normal edge
+            auto normal = invoke->getNormalDest();
+            if (normal->getSinglePredecessor() == nullptr) {
+                normal = llvm::SplitEdge(invoke->getParent(), normal);
+            }
+            builder.SetInsertPoint(&*normal->getFirstInsertionPt());
+        }
+        else if (llvm::isa<llvm::PHINode>(inst)) {
+            // Phis have to stay grouped at the top of their block
+            builder.SetInsertPoint(&*inst->getParent()->getFirstInsertionPt());
+        }
+        else {
+            builder.SetInsertPoint(inst->getNextNode());
+        }
+
+        auto value = builder.CreatePointerCast(roots[i], slot_type);
+        builder.CreateStore(value, builder.CreateConstGEP1_64(frame, i));
+    }
+
+    // Pop the frame. A frame left behind by an exception is popped by the
+    // handler that catches it, which restores the root stack it saved.
+    for (auto exit: exits) {
+        builder.SetInsertPoint(exit);
+        builder.CreateStore(frame, top_ref);
+    }
+
+    return true;
+}
+
+void ShadowStackRootStrategy::prepareFunction(llvm::Function* func) const {
+    // No GC strategy: calls stay plain calls, and no stack map is emitted.
+    // The lowering pass only gives a frame to the functions marked here.
+    func->addFnAttr(kShadowStackAttribute);
+}
+
+void ShadowStackRootStrategy::addLoweringPasses(llvm::legacy::PassManager& pm) const {
+    pm.add(new ShadowStackLowering());
+}
+
+}
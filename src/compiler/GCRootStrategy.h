@@ -0,0 +1,89 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_GCROOTSTRATEGY_H
+#define ELECTRUM_GCROOTSTRATEGY_H
+
+#include <memory>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LegacyPassManager.h>
+
+namespace electrum {
+
+/** Address space of pointers to garbage collected objects in compiled code */
+static const unsigned kGCPointerAddressSpace = 1;
+
+/**
+ * Decides how the collector finds the roots held by compiled code. The
+ * compiler creates every function through the strategy, and the JIT runs
+ * the strategy's lowering passes once IR optimization has finished.
+ */
+class GCRootStrategy {
+public:
+    virtual ~GCRootStrategy() = default;
+
+    /** @return A short name for the strategy, for diagnostics and benchmarks */
+    virtual const char* name() const = 0;
+
+    /** Prepare a newly created function for the strategy */
+    virtual void prepareFunction(llvm::Function* func) const = 0;
+
+    /**
+     * Add the passes that make the roots of each function visible to the
+     * collector. They run after every IR optimization pass.
+     */
+    virtual void addLoweringPasses(llvm::legacy::PassManager& pm) const = 0;
+};
+
+/**
+ * Precise roots from LLVM statepoints. Every call becomes a statepoint
+ * whose live GC pointers are recorded in the module's stack map, and the
+ * collector walks the machine stack with them, relocating the pointers
+ * in place.
+ */
+class StackMapRootStrategy : public GCRootStrategy {
+public:
+    const char* name() const override { return "stackmap"; }
+    void prepareFunction(llvm::Function* func) const override;
+    void addLoweringPasses(llvm::legacy::PassManager& pm) const override;
+};
+
+/**
+ * Roots kept on the collector's root stack. On entry each function pushes
+ * a frame with one slot for each GC pointer it holds: its arguments, and
+ * the results of its calls and loads. The slots are stored to as the
+ * values are produced, and the frame is popped on return. Objects in a
+ * frame are pinned by the collector rather than relocated, so no stack
+ * maps, statepoints or stack walks are needed.
+ */
+class ShadowStackRootStrategy : public GCRootStrategy {
+public:
+    const char* name() const override { return "shadow-stack"; }
+    void prepareFunction(llvm::Function* func) const override;
+    void addLoweringPasses(llvm::legacy::PassManager& pm) const override;
+};
+
+}
+
+#endif //ELECTRUM_GCROOTSTRATEGY_H
@@ -53,6 +53,7 @@ pair<shared_ptr<ASTNode>, vector<Token>::iterator> Parser::readTokens(vector<Tok
         case kTokenTypeSymbol: return make_pair(parseSymbol(t), it);
         case kTokenTypeKeyword: return make_pair(parseKeyword(t), it);
         case kTokenTypeString: return make_pair(parseString(t), it);
+        case kTokenTypeChar: return make_pair(parseChar(t), it);
         case kTokenTypeNil: return make_pair(parseNil(t), it);
         case kTokenTypeQuote: {
             return parseQuote(tokens, ++it, kQuoteTypeQuote);
@@ -177,6 +178,45 @@ shared_ptr<ASTNode> Parser::parseString(const Token& t) const {
     return val;
 }
 
+/** @return The code point of the one UTF-8 encoded character in text */
+static int64_t decodeUTF8(const string& text) {
+    auto bytes = reinterpret_cast<const unsigned char*>(text.data());
+    if (bytes[0] < 0x80) {
+        return bytes[0];
+    }
+
+    size_t  length    = bytes[0] >= 0xF0 ? 4 : bytes[0] >= 0xE0 ? 3 : 2;
+    int64_t codePoint = bytes[0] & (0x7F >> length);
+    for (size_t i = 1; i < length && i < text.size(); i++) {
+        codePoint = (codePoint << 6) | (bytes[i] & 0x3F);
+    }
+
+    return codePoint;
+}
+
+shared_ptr<ASTNode> Parser::parseChar(const Token& t) const {
+    auto val = make_shared<ASTNode>();
+    val->tag = kTypeTagChar;
+
+    // Remove the #\ prefix, leaving a name or the character itself
+    auto text = t.text.substr(2);
+    if (text == "space") {
+        val->integerValue = ' ';
+    } else if (text == "newline") {
+        val->integerValue = '\n';
+    } else if (text == "tab") {
+        val->integerValue = '\t';
+    } else {
+        val->integerValue = decodeUTF8(text);
+    }
+
+    val->sourcePosition           = make_shared<SourcePosition>();
+    val->sourcePosition->line     = t.line;
+    val->sourcePosition->column   = t.column;
+    val->sourcePosition->filename = t.filename;
+    return val;
+}
+
 pair<shared_ptr<ASTNode>, vector<Token>::iterator> Parser::parseList(vector<Token>* tokens,
         vector<Token>::iterator it) const {
     auto list = make_shared<vector<shared_ptr<ASTNode>>>();
@@ -310,15 +350,19 @@ shared_ptr<ASTNode> Parser::readLispValue(void* val, const shared_ptr<SourcePosi
     }
     else if (rt_is_string(val) == TRUE_PTR) {
         form->tag         = kTypeTagString;
-        form->stringValue = make_shared<string>(rt_string_value(val));
+        form->stringValue = make_shared<string>(electrum::name_string(val));
     }
     else if (rt_is_keyword(val) == TRUE_PTR) {
         form->tag = kTypeTagKeyword;
-        form->stringValue = make_shared<string>(rt_keyword_extract_string(val));
+        form->stringValue = make_shared<string>(electrum::name_string(val));
     }
     else if (rt_is_symbol(val) == TRUE_PTR) {
         form->tag         = kTypeTagSymbol;
-        form->stringValue = make_shared<string>(rt_symbol_extract_string(val));
+        form->stringValue = make_shared<string>(electrum::name_string(val));
+    }
+    else if (rt_is_char(val) == TRUE_PTR) {
+        form->tag          = kTypeTagChar;
+        form->integerValue = rt_char_value(val);
     }
     else if (rt_is_pair(val) == TRUE_PTR) {
         form->tag = kTypeTagList;
@@ -62,6 +62,7 @@ class Parser {
 public:
     shared_ptr<ASTNode> readString(const string& input, const string& filename) const;
     shared_ptr<ASTNode> parseString(const Token& t) const;
+    shared_ptr<ASTNode> parseChar(const Token& t) const;
     shared_ptr<ASTNode> parseBoolean(const Token& t) const;
     shared_ptr<ASTNode> parseKeyword(const Token& t) const;
     shared_ptr<ASTNode> parseNil(const Token& t) const;
@@ -0,0 +1,304 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "HeapGraph.h"
+#include "runtime/HeapSnapshot.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace electrum {
+
+/**
+ * Reads the parts of a snapshot file
+ */
+class SnapshotReader {
+public:
+    explicit SnapshotReader(std::istream& in) :in_(in) {}
+
+    void read_bytes(void* data, size_t length) {
+        if (!in_.read(static_cast<char*>(data), static_cast<std::streamsize>(length))) {
+            throw std::runtime_error("Heap snapshot is truncated");
+        }
+    }
+
+    uint32_t read_uint32() {
+        uint8_t bytes[4];
+        read_bytes(bytes, sizeof(bytes));
+        return bytes[0] | (bytes[1] << 8U) | (bytes[2] << 16U) | (static_cast<uint32_t>(bytes[3]) << 24U);
+    }
+
+    /** Read an unsigned LEB128 integer */
+    uint64_t read_uint() {
+        uint64_t value = 0;
+        uint8_t  byte;
+        unsigned shift = 0;
+
+        do {
+            if (shift >= 64) {
+                throw std::runtime_error("Heap snapshot has a malformed integer");
+            }
+            read_bytes(&byte, 1);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        return value;
+    }
+
+    std::string read_string(size_t max_length) {
+        auto length = read_uint();
+        if (length > max_length) {
+            throw std::runtime_error("Heap snapshot has a malformed string");
+        }
+
+        std::string str(length, '\0');
+        read_bytes(&str[0], length);
+        return str;
+    }
+
+private:
+    std::istream& in_;
+};
+
+HeapGraph HeapGraph::read(std::istream& in) {
+    SnapshotReader reader(in);
+    HeapGraph      graph;
+
+    char magic[sizeof(kHeapSnapshotMagic)];
+    reader.read_bytes(magic, sizeof(magic));
+    if (memcmp(magic, kHeapSnapshotMagic, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a heap snapshot");
+    }
+
+    auto version = reader.read_uint32();
+    if (version != kHeapSnapshotVersion) {
+        throw std::runtime_error("Unsupported heap snapshot version " + std::to_string(version));
+    }
+
+    auto num_types = reader.read_uint();
+    for (uint64_t i = 0; i < num_types; i++) {
+        auto tag = reader.read_uint();
+        if (tag > UINT32_MAX) {
+            throw std::runtime_error("Heap snapshot has a malformed type tag");
+        }
+
+        if (tag >= graph.type_names_.size()) {
+            graph.type_names_.resize(tag + 1);
+        }
+        graph.type_names_[tag] = reader.read_string(kHeapSnapshotMaxLabel);
+    }
+
+    auto num_nodes = reader.read_uint();
+    for (uint64_t i = 0; i < num_nodes; i++) {
+        HeapNode node;
+        node.tag        = static_cast<uint32_t>(reader.read_uint());
+        node.size       = reader.read_uint();
+        node.root_kinds = static_cast<uint8_t>(reader.read_uint());
+        node.label      = reader.read_string(kHeapSnapshotMaxLabel);
+        node.first_edge = graph.edges_.size();
+        node.num_edges  = reader.read_uint();
+
+        for (size_t j = 0; j < node.num_edges; j++) {
+            auto target = reader.read_uint();
+            if (target >= num_nodes) {
+                throw std::runtime_error("Heap snapshot has an edge to a missing object");
+            }
+            graph.edges_.push_back(target);
+        }
+
+        graph.nodes_.push_back(std::move(node));
+    }
+
+    return graph;
+}
+
+std::string HeapGraph::type_name(uint32_t tag) const {
+    if (tag < type_names_.size() && !type_names_[tag].empty()) {
+        return type_names_[tag];
+    }
+
+    return "type-" + std::to_string(tag);
+}
+
+DominatorTree::DominatorTree(const HeapGraph& graph) {
+    static const size_t kNone = SIZE_MAX;
+
+    // Vertex 0 is a virtual root with an edge to every root of the heap.
+    // Node i of the graph is vertex i + 1.
+    auto num_vertices = graph.size() + 1;
+
+    std::vector<size_t> roots;
+    for (size_t i = 0; i < graph.size(); i++) {
+        if (graph.node(i).root_kinds != 0) {
+            roots.push_back(i + 1);
+        }
+    }
+
+    auto num_successors = [&](size_t v) {
+      return v == 0 ? roots.size() : graph.node(v - 1).num_edges;
+    };
+    auto successor = [&](size_t v, size_t k) {
+      return v == 0 ? roots[k] : graph.edge(graph.node(v - 1).first_edge + k) + 1;
+    };
+
+    // Number the vertices in depth first order
+    std::vector<size_t> dfnum(num_vertices, kNone);
+    std::vector<size_t> parent(num_vertices, kNone);
+    std::vector<size_t> vertex;
+    vertex.reserve(num_vertices);
+
+    std::vector<std::pair<size_t, size_t>> stack;
+    dfnum[0] = 0;
+    vertex.push_back(0);
+    stack.emplace_back(0, 0);
+
+    while (!stack.empty()) {
+        auto v = stack.back().first;
+        auto k = stack.back().second;
+
+        if (k == num_successors(v)) {
+            stack.pop_back();
+            continue;
+        }
+
+        stack.back().second++;
+
+        auto w = successor(v, k);
+        if (dfnum[w] == kNone) {
+            dfnum[w]  = vertex.size();
+            parent[w] = v;
+            vertex.push_back(w);
+            stack.emplace_back(w, 0);
+        }
+    }
+
+    // Predecessors of the reachable vertices, in compressed sparse row form
+    std::vector<size_t> pred_start(num_vertices + 1, 0);
+    for (auto v: vertex) {
+        for (size_t k = 0; k < num_successors(v); k++) {
+            pred_start[successor(v, k) + 1]++;
+        }
+    }
+    for (size_t v = 0; v < num_vertices; v++) {
+        pred_start[v + 1] += pred_start[v];
+    }
+
+    std::vector<size_t> preds(pred_start[num_vertices]);
+    std::vector<size_t> pred_fill(pred_start.begin(), pred_start.end() - 1);
+    for (auto v: vertex) {
+        for (size_t k = 0; k < num_successors(v); k++) {
+            preds[pred_fill[successor(v, k)]++] = v;
+        }
+    }
+
+    std::vector<size_t> semi(dfnum);
+    std::vector<size_t> idom(num_vertices, kNone);
+    std::vector<size_t> ancestor(num_vertices, kNone);
+    std::vector<size_t> label(num_vertices);
+    std::vector<size_t> bucket_head(num_vertices, kNone);
+    std::vector<size_t> bucket_next(num_vertices, kNone);
+    std::vector<size_t> path;
+
+    for (size_t v = 0; v < num_vertices; v++) {
+        label[v] = v;
+    }
+
+    // The vertex with the smallest semidominator on the path from v to the
+    // root of its forest tree, compressing the path as it goes
+    auto eval = [&](size_t v) {
+      if (ancestor[v] == kNone) {
+          return v;
+      }
+
+      path.clear();
+      for (auto x = v; ancestor[ancestor[x]] != kNone; x = ancestor[x]) {
+          path.push_back(x);
+      }
+
+      for (auto it = path.rbegin(); it != path.rend(); ++it) {
+          auto x = *it;
+          auto a = ancestor[x];
+          if (semi[label[a]] < semi[label[x]]) {
+              label[x] = label[a];
+          }
+          ancestor[x] = ancestor[a];
+      }
+
+      return label[v];
+    };
+
+    for (auto i = vertex.size() - 1; i > 0; i--) {
+        auto w = vertex[i];
+
+        for (auto j = pred_start[w]; j < pred_start[w + 1]; j++) {
+            auto u = eval(preds[j]);
+            if (semi[u] < semi[w]) {
+                semi[w] = semi[u];
+            }
+        }
+
+        auto s = vertex[semi[w]];
+        bucket_next[w] = bucket_head[s];
+        bucket_head[s] = w;
+
+        auto p = parent[w];
+        ancestor[w] = p;
+
+        for (auto v = bucket_head[p]; v != kNone; v = bucket_next[v]) {
+            auto u = eval(v);
+            idom[v] = semi[u] < semi[v] ? u : p;
+        }
+        bucket_head[p] = kNone;
+    }
+
+    for (size_t i = 1; i < vertex.size(); i++) {
+        auto w = vertex[i];
+        if (idom[w] != vertex[semi[w]]) {
+            idom[w] = idom[idom[w]];
+        }
+    }
+
+    // A dominator comes before everything it dominates in depth first
+    // order, so sizes can be rolled up in reverse
+    std::vector<uint64_t> retained(num_vertices, 0);
+    for (size_t i = 0; i < graph.size(); i++) {
+        retained[i + 1] = graph.node(i).size;
+    }
+
+    for (auto i = vertex.size() - 1; i > 0; i--) {
+        auto w = vertex[i];
+        retained[idom[w]] += retained[w];
+    }
+
+    dominators_.resize(graph.size(), kHeapGraphRoot);
+    retained_sizes_.resize(graph.size(), 0);
+
+    for (size_t i = 1; i < vertex.size(); i++) {
+        auto w = vertex[i];
+        dominators_[w - 1]     = idom[w] == 0 ? kHeapGraphRoot : idom[w] - 1;
+        retained_sizes_[w - 1] = retained[w];
+    }
+}
+
+}
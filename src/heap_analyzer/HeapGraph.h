@@ -0,0 +1,105 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_HEAPGRAPH_H
+#define ELECTRUM_HEAPGRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace electrum {
+
+/** Stands for the roots of the heap, which dominate every object */
+static const size_t kHeapGraphRoot = SIZE_MAX;
+
+/** An object in a heap snapshot */
+struct HeapNode {
+  uint32_t    tag;
+  uint64_t    size;
+  uint8_t     root_kinds;
+  std::string label;
+
+  /** The node's outgoing edges are HeapGraph::edge(first_edge) to edge(first_edge + num_edges - 1) */
+  size_t first_edge;
+  size_t num_edges;
+};
+
+/**
+ * The object graph of a heap snapshot written by write_heap_snapshot
+ */
+class HeapGraph {
+public:
+    /**
+     * Read a snapshot
+     * @throws std::runtime_error If the snapshot is truncated or malformed
+     */
+    static HeapGraph read(std::istream& in);
+
+    size_t size() const { return nodes_.size(); }
+
+    const HeapNode& node(size_t index) const { return nodes_[index]; }
+
+    /** @return The node the edge points to */
+    size_t edge(size_t index) const { return edges_[index]; }
+
+    /** @return The name of a type tag, as recorded in the snapshot */
+    std::string type_name(uint32_t tag) const;
+
+private:
+    std::vector<std::string> type_names_;
+    std::vector<HeapNode>    nodes_;
+    std::vector<size_t>      edges_;
+};
+
+/**
+ * The dominator tree of a heap graph. An object dominates another if every
+ * path from the roots to the other passes through it, so the memory an
+ * object retains (what would be freed if it was dropped) is its own size
+ * plus that of every object it dominates.
+ *
+ * Built with the Lengauer-Tarjan algorithm, using iterative depth first
+ * search and path compression so that large heaps cannot overflow the
+ * stack.
+ */
+class DominatorTree {
+public:
+    explicit DominatorTree(const HeapGraph& graph);
+
+    /** @return The immediate dominator of a node, or kHeapGraphRoot if only the roots dominate it */
+    size_t dominator(size_t node) const { return dominators_[node]; }
+
+    /** @return The bytes that would be freed if nothing else referred to the node */
+    uint64_t retained_size(size_t node) const { return retained_sizes_[node]; }
+
+private:
+    std::vector<size_t>   dominators_;
+    std::vector<uint64_t> retained_sizes_;
+};
+
+}
+
+#endif //ELECTRUM_HEAPGRAPH_H
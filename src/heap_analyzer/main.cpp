@@ -0,0 +1,181 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "HeapGraph.h"
+#include "runtime/HeapSnapshot.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+using namespace electrum;
+
+static void usage() {
+    std::cerr << "usage: electrum_heap_analyzer [--top N] snapshot" << std::endl;
+}
+
+static std::string root_description(uint8_t root_kinds) {
+    static const std::pair<uint8_t, const char*> kinds[] = {
+            {kHeapRootStack,        "stack"},
+            {kHeapRootGlobal,       "global"},
+            {kHeapRootPinned,       "pinned"},
+            {kHeapRootRootStack,    "root-stack"},
+            {kHeapRootConservative, "conservative"},
+            {kHeapRootException,    "exception"}
+    };
+
+    std::string description;
+    for (auto& kind: kinds) {
+        if (root_kinds & kind.first) {
+            description += description.empty() ? " [" : ",";
+            description += kind.second;
+        }
+    }
+
+    return description.empty() ? description : description + "]";
+}
+
+/**
+ * @return The type of a node, with its label. A var is labelled with the
+ * name of the symbol it is bound to.
+ */
+static std::string node_description(const HeapGraph& graph, size_t index) {
+    auto& node        = graph.node(index);
+    auto  description = graph.type_name(node.tag);
+    auto  label       = node.label;
+
+    if (label.empty() && description == "var" && node.num_edges > 0) {
+        label = graph.node(graph.edge(node.first_edge)).label;
+    }
+
+    if (!label.empty()) {
+        description += " " + label;
+    }
+
+    return description;
+}
+
+/**
+ * @return The closest var that dominates the node, or kHeapGraphRoot
+ */
+static size_t dominating_var(const HeapGraph& graph, const DominatorTree& tree, size_t index) {
+    for (auto node = tree.dominator(index); node != kHeapGraphRoot; node = tree.dominator(node)) {
+        if (graph.type_name(graph.node(node).tag) == "var") {
+            return node;
+        }
+    }
+
+    return kHeapGraphRoot;
+}
+
+int main(int argc, char* argv[]) {
+    size_t      top  = 20;
+    const char* path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+            top = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (path == nullptr && argv[i][0] != '-') {
+            path = argv[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (path == nullptr) {
+        usage();
+        return 1;
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return 1;
+    }
+
+    HeapGraph graph;
+    try {
+        graph = HeapGraph::read(in);
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << path << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    DominatorTree tree(graph);
+
+    // Totals by type
+    std::map<std::string, std::pair<uint64_t, uint64_t>> types;
+    uint64_t                                             total_size = 0;
+    for (size_t i = 0; i < graph.size(); i++) {
+        auto& totals = types[graph.type_name(graph.node(i).tag)];
+        totals.first++;
+        totals.second += graph.node(i).size;
+        total_size += graph.node(i).size;
+    }
+
+    std::cout << graph.size() << " objects, " << total_size << " bytes reachable" << std::endl << std::endl;
+
+    std::cout << std::setw(12) << "count" << std::setw(14) << "bytes" << "  type" << std::endl;
+    for (auto& type: types) {
+        std::cout << std::setw(12) << type.second.first
+                  << std::setw(14) << type.second.second
+                  << "  " << type.first << std::endl;
+    }
+    std::cout << std::endl;
+
+    // The objects retaining the most memory
+    std::vector<size_t> order(graph.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+
+    top = std::min(top, order.size());
+    std::partial_sort(order.begin(), order.begin() + top, order.end(), [&tree](size_t a, size_t b) {
+      return tree.retained_size(a) > tree.retained_size(b);
+    });
+
+    std::cout << std::setw(14) << "retained" << std::setw(10) << "self" << "  object" << std::endl;
+    for (size_t i = 0; i < top; i++) {
+        auto index = order[i];
+        std::cout << std::setw(14) << tree.retained_size(index)
+                  << std::setw(10) << graph.node(index).size
+                  << "  " << node_description(graph, index)
+                  << root_description(graph.node(index).root_kinds);
+
+        auto var = dominating_var(graph, tree, index);
+        if (var != kHeapGraphRoot) {
+            std::cout << " (held by " << node_description(graph, var) << ")";
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
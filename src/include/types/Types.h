@@ -47,7 +47,8 @@ enum TypeTag {
   kTypeTagString,
   kTypeTagNil,
   kTypeTagSymbol,
-  kTypeTagKeyword
+  kTypeTagKeyword,
+  kTypeTagChar
 };
 
 struct SourcePosition {
@@ -77,7 +78,7 @@ struct ASTNode {
   shared_ptr<SourcePosition> sourcePosition;
 
   union {
-    int64_t integerValue;
+    int64_t integerValue;               // Also the codepoint of a char
     double floatValue;
     bool booleanValue;
   };
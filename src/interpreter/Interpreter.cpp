@@ -58,6 +58,12 @@ void* Interpreter::evalExpr(void* expr, void* env) {
     else if (expr==NIL_PTR) {
         return theExpr;
     }
+    else if (is_float_immediate(theExpr) || is_short_string(theExpr) || is_short_keyword(theExpr) || is_char(theExpr)) {
+        return theExpr;
+    }
+    else if (is_short_symbol(theExpr)) {
+        return this->lookup_symbol(theExpr, theEnv);
+    }
     else if (is_object(theExpr)) {
         auto header = TAG_TO_OBJECT(theExpr);
 
@@ -68,9 +74,8 @@ void* Interpreter::evalExpr(void* expr, void* env) {
         case kETypeTagSymbol:return this->lookup_symbol(theExpr, theEnv);
         case kETypeTagPair: {
             auto pair = static_cast<EPair*>(static_cast<void*>(header));
-            if (is_object_with_tag(pair->value, kETypeTagSymbol)) {
-                auto sym = static_cast<ESymbol*>(static_cast<void*>(TAG_TO_OBJECT(pair->value)));
-                auto name = std::string(sym->name);
+            if (is_symbol(pair->value)) {
+                auto name = electrum::name_string(pair->value);
 
                 // Eval special forms
                 if (name=="if") {
@@ -195,7 +200,7 @@ void* Interpreter::eval_lambda(void* expr, void* env) {
             arg = evalExpr(arg, env);
         }
 
-        if (!is_object_with_tag(arg, kETypeTagSymbol)) {
+        if (!is_symbol(arg)) {
             throw InterpreterException("Lambda arguments must be symbols", nullptr);
         }
 
@@ -229,7 +234,7 @@ void Interpreter::eval_define(void* expr, void* env) {
         throw InterpreterException("define requires a symbol to bind to!", nullptr);
     }
 
-    if (!is_object_with_tag(binding, kETypeTagSymbol)) {
+    if (!is_symbol(binding)) {
         throw InterpreterException("define requires a symbol to bind to!", nullptr);
     }
 
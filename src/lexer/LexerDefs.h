@@ -45,6 +45,7 @@ enum TokenType {
   kTokenTypeInteger,
   kTokenTypeBoolean,
   kTokenTypeString,
+  kTokenTypeChar,
   kTokenTypeNil,
   kTokenTypeEOF
 };
@@ -0,0 +1,185 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "AllocationProfiler.h"
+#include "StackMapIndex.h"
+#include "Runtime.h"
+#include <algorithm>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <sstream>
+#include <unwind.h>
+
+namespace electrum {
+
+struct Backtrace {
+  uint64_t frames[kAllocationSampleMaxFrames];
+  size_t   count;
+};
+
+static _Unwind_Reason_Code collect_frame(_Unwind_Context* context, void* arg) {
+    auto backtrace = static_cast<Backtrace*>(arg);
+    if (backtrace->count == kAllocationSampleMaxFrames) {
+        return _URC_END_OF_STACK;
+    }
+
+    backtrace->frames[backtrace->count++] = static_cast<uint64_t>(_Unwind_GetIP(context));
+    return _URC_NO_REASON;
+}
+
+/** @return The base address of the image the runtime was loaded from */
+static void* runtime_image() {
+    static void* image = []() -> void* {
+      Dl_info info;
+      if (dladdr(reinterpret_cast<void*>(&rt_gc_malloc_tagged_object), &info) == 0) {
+          return nullptr;
+      }
+      return info.dli_fbase;
+    }();
+
+    return image;
+}
+
+AllocationProfiler::AllocationProfiler()
+        :interval_(0) {
+}
+
+void AllocationProfiler::sample(void* obj, size_t size, const StackMapIndex& stack_maps) {
+    Backtrace backtrace;
+    backtrace.count = 0;
+    _Unwind_Backtrace(collect_frame, &backtrace);
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    // Prefer the innermost JIT'd frame, then the innermost native frame
+    // outside the runtime
+    uint64_t site = 0;
+    for (size_t i = 0; i < backtrace.count && site == 0; i++) {
+        if (is_jit_code(backtrace.frames[i], stack_maps)) {
+            site = backtrace.frames[i];
+        }
+    }
+
+    for (size_t i = 0; i < backtrace.count && site == 0; i++) {
+        Dl_info info;
+        auto    address = reinterpret_cast<void*>(backtrace.frames[i]);
+        if (dladdr(address, &info) != 0 && info.dli_fbase != runtime_image()) {
+            site = backtrace.frames[i];
+        }
+    }
+
+    pending_.push_back({obj, site, size, interval()});
+}
+
+bool AllocationProfiler::is_jit_code(uint64_t address, const StackMapIndex& stack_maps) {
+    auto it = code_.upper_bound(address);
+    if (it != code_.begin() && address <= std::prev(it)->second.end) {
+        return true;
+    }
+
+    // Every call from JIT'd code is a statepoint, so its return address is in a stack map
+    return stack_maps.lookup(address) != nullptr;
+}
+
+void AllocationProfiler::resolve_samples() {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    for (auto& sample: pending_) {
+        auto  tag   = static_cast<EObjectHeader*>(sample.obj)->tag;
+        auto& stats = sites_[std::make_pair(sample.return_address, tag)];
+        stats.samples++;
+        stats.sampled_bytes += sample.size;
+        stats.bytes += sample.weight;
+    }
+
+    pending_.clear();
+}
+
+void AllocationProfiler::clear() {
+    std::lock_guard<std::mutex> lock(lock_);
+    pending_.clear();
+    sites_.clear();
+}
+
+std::vector<AllocationSiteReport> AllocationProfiler::report() {
+    resolve_samples();
+
+    std::lock_guard<std::mutex>       lock(lock_);
+    std::vector<AllocationSiteReport> report;
+
+    for (auto& it: sites_) {
+        report.push_back({site_name(it.first.first), it.first.first, it.first.second, it.second.samples,
+                          it.second.sampled_bytes, it.second.bytes});
+    }
+
+    std::stable_sort(report.begin(), report.end(), [](const AllocationSiteReport& a, const AllocationSiteReport& b) {
+      return a.bytes > b.bytes;
+    });
+
+    return report;
+}
+
+void AllocationProfiler::add_code(const char* name, uint64_t start, uint64_t size) {
+    std::lock_guard<std::mutex> lock(lock_);
+    code_[start] = {start + size, name};
+}
+
+void AllocationProfiler::remove_code(uint64_t start) {
+    std::lock_guard<std::mutex> lock(lock_);
+    code_.erase(start);
+}
+
+/**
+ * @return The function containing address, with the offset of address in it
+ */
+std::string AllocationProfiler::site_name(uint64_t address) {
+    std::ostringstream name;
+
+    if (address == 0) {
+        return "<unknown>";
+    }
+
+    auto it = code_.upper_bound(address);
+    if (it != code_.begin() && address <= std::prev(it)->second.end) {
+        --it;
+        name << it->second.name << "+0x" << std::hex << (address - it->first);
+        return name.str();
+    }
+
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(address), &info) != 0 && info.dli_sname != nullptr) {
+        int  status;
+        auto demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+
+        name << (status == 0 ? demangled : info.dli_sname)
+             << "+0x" << std::hex << (address - reinterpret_cast<uint64_t>(info.dli_saddr));
+        std::free(demangled);
+        return name.str();
+    }
+
+    name << "0x" << std::hex << address;
+    return name.str();
+}
+
+}
@@ -0,0 +1,144 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_ALLOCATIONPROFILER_H
+#define ELECTRUM_ALLOCATIONPROFILER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace electrum {
+
+class StackMapIndex;
+
+/** Return addresses looked at when finding the call site of a sample */
+static const size_t kAllocationSampleMaxFrames = 64;
+
+/**
+ * Allocation from a call site, of one type
+ */
+struct AllocationSiteReport {
+  /** The call site, as a function name and offset when it is known */
+  std::string site;
+  uint64_t    return_address;
+  uint32_t    tag;
+  uint64_t    samples;
+
+  /** Total size of the sampled objects */
+  uint64_t sampled_bytes;
+
+  /** Bytes allocated, estimated as one sample interval per sample */
+  uint64_t bytes;
+};
+
+/**
+ * Samples allocations every N bytes, recording the type, size and call
+ * site of the object that crosses each sample point. Each thread counts
+ * down to its next sample point in its AllocationBuffer, so only the
+ * allocations that take a sample pay for it.
+ *
+ * The call site is the innermost return address in JIT'd code, found
+ * through the code registered by the JIT or the stack maps. Allocations
+ * made without any JIT'd code on the stack are attributed to the closest
+ * native caller outside the runtime.
+ *
+ * Type tags are written by the caller after the object is allocated, so
+ * a sample's tag is read later, when a collection starts or a report is
+ * made.
+ */
+class AllocationProfiler {
+public:
+    AllocationProfiler();
+
+    /** @return Bytes between samples, or zero when profiling is off */
+    size_t interval() const { return interval_.load(std::memory_order_relaxed); }
+
+    /** Start sampling every interval bytes, or stop when interval is zero. Keeps earlier samples. */
+    void set_interval(size_t interval) { interval_.store(interval, std::memory_order_relaxed); }
+
+    /**
+     * Record an allocation that crossed a sample point
+     * @param obj The object, whose tag will be set by the caller
+     * @param size The size of the object
+     * @param stack_maps Call sites of the JIT'd code, to find the Lisp level call site
+     */
+    void sample(void* obj, size_t size, const StackMapIndex& stack_maps);
+
+    /** Read the tags of samples whose objects have been initialised since */
+    void resolve_samples();
+
+    /** Forget every sample */
+    void clear();
+
+    /** @return The estimated bytes allocated by each site and type, largest first */
+    std::vector<AllocationSiteReport> report();
+
+    /** Name the JIT'd code in [start, start + size) */
+    void add_code(const char* name, uint64_t start, uint64_t size);
+    void remove_code(uint64_t start);
+
+private:
+    struct PendingSample {
+      void*    obj;
+      uint64_t return_address;
+      uint64_t size;
+
+      /** The sample interval when the sample was taken */
+      uint64_t weight;
+    };
+
+    struct SiteStats {
+      uint64_t samples;
+      uint64_t sampled_bytes;
+      uint64_t bytes;
+    };
+
+    struct CodeRange {
+      uint64_t    end;
+      std::string name;
+    };
+
+    std::atomic<size_t> interval_;
+    std::mutex          lock_;
+
+    std::vector<PendingSample> pending_;
+
+    /** Samples by return address and type tag */
+    std::map<std::pair<uint64_t, uint32_t>, SiteStats> sites_;
+
+    /** JIT'd functions by start address */
+    std::map<uint64_t, CodeRange> code_;
+
+    bool is_jit_code(uint64_t address, const StackMapIndex& stack_maps);
+    std::string site_name(uint64_t address);
+};
+
+}
+
+#endif //ELECTRUM_ALLOCATIONPROFILER_H
@@ -64,7 +64,7 @@ extern "C" void* el_rt_allocate_exception(const char* exc_type, const char* mess
     exc->header.gc_mark = 0;
     exc->header.tag = kETypeTagException;
 
-    exc->exception_type = static_cast<char*>(malloc(strlen(exc_type)));
+    exc->exception_type = static_cast<char*>(malloc(strlen(exc_type) + 1));
     strcpy(exc->exception_type, exc_type);
 
     exc->metadata = meta;
@@ -95,15 +95,15 @@ extern "C" void* el_rt_make_exception(void* exc_type, void* message, void* meta)
         el_rt_throw(exc);
     }
 
-    const char* msg = nullptr;
+    std::string msg;
 
     if (message!=NIL_PTR) {
-        msg = rt_string_value(message);
+        msg = electrum::name_string(message);
     }
 
     return el_rt_allocate_exception(
-            rt_symbol_extract_string(exc_type),
-            msg,
+            electrum::name_string(exc_type).c_str(),
+            message!=NIL_PTR ? msg.c_str() : nullptr,
             meta);
 }
 
@@ -27,209 +27,1504 @@
 #include "GarbageCollector.h"
 #include "stackmap/api.h"
 #include "Runtime.h"
+#include "ObjectLayout.h"
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 #include "Dwarf_eh.h"
+#include <sys/mman.h>
+#include <pthread.h>
+#include <csetjmp>
+#include <mutex>
+
+int64_t rt_gc_allocation_budget = 0;
+uint8_t rt_gc_requested = 0;
+void** rt_gc_root_stack_top = nullptr;
+void** rt_gc_root_stack_limit = nullptr;
 
 namespace electrum {
 
-GarbageCollector::GarbageCollector(GCMode mode)
-        :collector_mode_(mode),
-         current_exception(NIL_PTR) {
-    switch (mode) {
-    case kGCModeCompilerOwned:scan_stack_ = true;
-        break;
-    case kGCModeInterpreterOwned:
-        // If the GC is owned by the interpreter, we won't have a
-        // stack map to scan
-        scan_stack_ = false;
+struct ThreadAllocationBuffer;
+
+/** The allocation buffer of every live thread, so a collection can retire them */
+static std::mutex                           allocation_buffers_lock;
+static std::vector<ThreadAllocationBuffer*> allocation_buffers;
+
+/**
+ * Set by the owning thread while it collects. Threads check it before bump
+ * allocating, and take the slow path, which waits for the collection, if
+ * it is set.
+ */
+static std::atomic<bool> collection_running(false);
+
+/** Allocated by threads that exited since the buffers were last retired */
+static size_t exited_thread_objects = 0;
+static size_t exited_thread_bytes   = 0;
+
+/**
+ * Registers the calling thread's allocation buffer for the lifetime of the
+ * thread.
+ */
+struct ThreadAllocationBuffer {
+  AllocationBuffer buffer;
+
+  /** Set while the thread bump allocates, so a collection can wait for it to finish */
+  std::atomic<bool> bumping;
+
+  ThreadAllocationBuffer() :bumping(false) {
+      std::lock_guard<std::mutex> lock(allocation_buffers_lock);
+      allocation_buffers.push_back(this);
+  }
+
+  ~ThreadAllocationBuffer() {
+      std::lock_guard<std::mutex> lock(allocation_buffers_lock);
+      exited_thread_objects += buffer.objects;
+      exited_thread_bytes += buffer.bytes;
+      allocation_buffers.erase(std::find(allocation_buffers.begin(), allocation_buffers.end(), this));
+  }
+};
+
+static thread_local ThreadAllocationBuffer thread_allocation_buffer;
+
+/**
+ * Wait for the bump allocations that started before collection_running
+ * was set. Any later ones see it set and take the slow path.
+ */
+static void wait_for_bump_allocations() {
+    std::lock_guard<std::mutex> lock(allocation_buffers_lock);
+
+    for (auto thread_buffer: allocation_buffers) {
+        while (thread_buffer->bumping.load()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * Holds the collection lock exclusively for the outermost collection on
+ * the owning thread, and stops bump allocation, so no other thread
+ * allocates while objects move.
+ */
+class CollectionScope {
+public:
+    CollectionScope(std::shared_mutex& lock, uint32_t& depth) :lock_(lock), depth_(depth) {
+        if (depth_++ == 0) {
+            lock_.lock();
+            collection_running.store(true);
+            wait_for_bump_allocations();
+        }
+    }
+
+    ~CollectionScope() {
+        if (--depth_ == 0) {
+            collection_running.store(false);
+            lock_.unlock();
+        }
+    }
+
+private:
+    std::shared_mutex& lock_;
+    uint32_t& depth_;
+};
+
+/** Allocations in progress on the calling thread, which may nest when allocating an exception */
+static thread_local uint32_t shared_allocation_depth = 0;
+
+/**
+ * Shares the collection lock while a thread other than the owner
+ * allocates, so it waits for any collection in progress.
+ */
+class AllocationScope {
+public:
+    AllocationScope(std::shared_mutex& lock, bool owner) :lock_(owner ? nullptr : &lock) {
+        if (lock_ != nullptr && shared_allocation_depth++ == 0) {
+            lock_->lock_shared();
+        }
+    }
+
+    ~AllocationScope() {
+        if (lock_ != nullptr && --shared_allocation_depth == 0) {
+            lock_->unlock_shared();
+        }
+    }
+
+private:
+    std::shared_mutex* lock_;
+};
+
+/**
+ * Empty every thread's allocation buffer, so the next allocation of each
+ * thread takes a fresh block. Only called while no thread is allocating.
+ * @param objects Incremented by the number of objects allocated from the buffers
+ * @param bytes Incremented by the number of bytes allocated from the buffers
+ */
+static void retire_allocation_buffers(size_t& objects, size_t& bytes) {
+    std::lock_guard<std::mutex> lock(allocation_buffers_lock);
+
+    objects += exited_thread_objects;
+    bytes += exited_thread_bytes;
+    exited_thread_objects = 0;
+    exited_thread_bytes   = 0;
+
+    for (auto thread_buffer: allocation_buffers) {
+        auto buffer = &thread_buffer->buffer;
+        objects += buffer->objects;
+        bytes   += buffer->bytes;
+
+        buffer->cursor      = nullptr;
+        buffer->limit       = nullptr;
+        buffer->end         = nullptr;
+        buffer->sample_base = nullptr;
+        buffer->objects     = 0;
+        buffer->bytes   = 0;
+    }
+}
+
+/** @return Microseconds elapsed since start */
+static uint64_t microseconds_since(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+/**
+ * @return The highest address of the calling thread's stack
+ */
+static uintptr_t find_stack_top() {
+#ifdef __APPLE__
+    return reinterpret_cast<uintptr_t>(pthread_get_stackaddr_np(pthread_self()));
+#else
+    pthread_attr_t attr;
+    void*          stack_low  = nullptr;
+    size_t         stack_size = 0;
+
+    pthread_getattr_np(pthread_self(), &attr);
+    pthread_attr_getstack(&attr, &stack_low, &stack_size);
+    pthread_attr_destroy(&attr);
+
+    return reinterpret_cast<uintptr_t>(stack_low) + stack_size;
+#endif
+}
+
+/**
+ * @return The highest address of the calling thread's stack, looked up
+ * once per thread
+ */
+static uintptr_t current_stack_top() {
+    static thread_local uintptr_t stack_top = find_stack_top();
+    return stack_top;
+}
+
+GarbageCollector::GarbageCollector(GCMode mode, GCConfig config)
+        :collector_mode_(mode),
+         config_(config),
+         conservative_stack_(mode == kGCModeInterpreterOwned && config.conservative_stack_scan),
+         current_exception(NIL_PTR),
+         nursery_(config.nursery_size, true),
+         old_space_(config.background_sweep),
+         owner_thread_(std::this_thread::get_id()),
+         collection_depth_(0),
+         allocated_old_bytes_(0),
+         old_space_bytes_(0),
+         marked_old_bytes_(0),
+         marker_(config.marker_threads),
+         marking_(false),
+         next_major_threshold_(config.major_collection_threshold),
+         young_objects_(0),
+         young_bytes_(0),
+         old_objects_(0),
+         survivor_objects_(0),
+         survivor_bytes_(0),
+         young_survivor_objects_(0),
+         young_survivor_bytes_(0),
+         allocating_out_of_memory_(false) {
+    mark_visitor_ = [this](EObjectHeader* obj, MarkWorker& worker) {
+      if (!nursery_.contains(obj)) {
+          worker.marked_bytes += object_size(obj);
+      }
+
+      visit_pointer_fields(obj, [this, &worker](void** field) {
+        if (!is_object(*field)) {
+            return;
+        }
+
+        auto child = TAG_TO_OBJECT(*field);
+        if (mark(child)) {
+            worker.deque.push(child);
+        }
+      });
+    };
+
+    switch (mode) {
+    case kGCModeCompilerOwned:scan_stack_ = true;
+        break;
+    case kGCModeInterpreterOwned:
+        // If the GC is owned by the interpreter, we won't have a
+        // stack map to scan
+        scan_stack_ = false;
+    }
+
+    // Reserve the root stack up front, so it never moves. Pages are only
+    // committed as the stack grows into them.
+    auto root_stack = mmap(nullptr,
+                           kRootStackCapacity * sizeof(void*),
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           -1,
+                           0);
+    if (root_stack == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    root_stack_base_       = static_cast<void**>(root_stack);
+    rt_gc_root_stack_top   = root_stack_base_;
+    rt_gc_root_stack_limit = root_stack_base_ + kRootStackCapacity;
+
+    profiler_.set_interval(config.allocation_sample_interval);
+    reset_allocation_budget();
+}
+
+GarbageCollector::~GarbageCollector() {
+    // The nursery and old space release their own memory, so nothing may
+    // still be allocating from it
+    size_t objects = 0;
+    size_t bytes   = 0;
+    retire_allocation_buffers(objects, bytes);
+    munmap(root_stack_base_, kRootStackCapacity * sizeof(void*));
+    rt_gc_root_stack_top   = nullptr;
+    rt_gc_root_stack_limit = nullptr;
+}
+
+void GarbageCollector::init_stackmap(void* stackmap) {
+    stack_maps_.add(stackmap);
+}
+
+/**
+ * Forget the call sites of an unloaded module
+ * @return False if the stackmap was never added
+ */
+bool GarbageCollector::remove_stackmap(void* stackmap) {
+    return stack_maps_.remove(stackmap);
+}
+
+/**
+ * Walk the JIT'd frames above a statepoint. The walk stops at the first
+ * return address without a stack map, which is usually a runtime function
+ * such as rt_apply() calling back into compiled code.
+ * @param stackPointer The stack pointer of the call point, or nullptr to skip the stack
+ * @param visitor Called with the frame info and the base address of each frame
+ * @return The address of the return address the walk stopped at, or 0
+ */
+template<typename F>
+uintptr_t GarbageCollector::visit_stack_frames(void* stackPointer, F&& visitor) {
+    if (stackPointer == nullptr) {
+        return 0;
+    }
+
+    auto return_address = *static_cast<uint64_t*>(stackPointer);
+
+    auto frame_info = get_frame_info(return_address);
+
+    auto stackIndex = reinterpret_cast<uintptr_t>(stackPointer);
+    stackIndex += sizeof(void*);
+
+    while (frame_info != nullptr) {
+        visitor(frame_info, stackIndex);
+
+        // Move to next frame
+        stackIndex     = stackIndex + frame_info->frameSize;
+        return_address = *reinterpret_cast<uint64_t*>(stackIndex);
+        stackIndex += sizeof(void*);
+        frame_info     = get_frame_info(return_address);
+    };
+
+    return stackIndex - sizeof(void*);
+}
+
+/**
+ * Visit the roots that are held by value: registered roots, pinned
+ * objects, the root stack, objects found on the C stack and the exception
+ * in flight.
+ */
+template<typename F>
+void GarbageCollector::visit_value_roots(F&& visitor) {
+    for (auto root: object_roots_) {
+        visitor(root);
+    }
+
+    for (auto& it: pin_counts_) {
+        visitor(it.first);
+    }
+
+    for (auto root = root_stack_base_; root < rt_gc_root_stack_top; root++) {
+        visitor(*root);
+    }
+
+    for (auto root: conservative_roots_) {
+        visitor(root);
+    }
+
+    visitor(current_exception);
+}
+
+/**
+ * Perform a garbage collection pass. A minor collection is run unless
+ * the old generation has grown enough to warrant a major one. With
+ * incremental marking enabled, a major collection is spread over many
+ * calls, each doing a slice of marking bounded by GCConfig::max_pause_us.
+ * @param stackPointer The stack pointer of the call point
+ */
+void GarbageCollector::collect(void* stackPointer) {
+    assert(is_owner_thread());
+    CollectionScope scope(collection_lock_, collection_depth_);
+
+    auto start    = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::microseconds(config_.max_pause_us);
+
+    if (marking_) {
+        collect_minor(stackPointer);
+
+        if (mark_slice(deadline)) {
+            finish_incremental_mark(stackPointer);
+        }
+    }
+    else if (old_space_bytes_ < next_major_threshold_ && !over_soft_limit()) {
+        collect_minor(stackPointer);
+    }
+    else if (config_.incremental_marking) {
+        start_incremental_mark(stackPointer);
+
+        if (mark_slice(deadline)) {
+            finish_incremental_mark(stackPointer);
+        }
+    }
+    else {
+        collect_major(stackPointer);
+    }
+
+    reset_allocation_budget();
+
+    auto pause_us = microseconds_since(start);
+    stats_.pauses++;
+    stats_.total_pause_us += pause_us;
+    stats_.max_pause_us = std::max(stats_.max_pause_us, pause_us);
+}
+
+/**
+ * Collect if a collection has been requested, normally because the
+ * allocation budget since the last collection is spent. Called from the
+ * slow path of every safepoint poll. Polls on other threads than the
+ * owner leave the collection to the owner.
+ * @param stackPointer The stack pointer of the call point
+ */
+void GarbageCollector::poll(void* stackPointer) {
+    if (collection_requested() && is_owner_thread()) {
+        collect(stackPointer);
+    }
+}
+
+/**
+ * The factor the old generation may grow by before the next major
+ * collection. Small heaps are allowed to grow quickly, so they are not
+ * collected over and over, while large heaps grow more slowly to bound
+ * the memory wasted on garbage.
+ * @param live_bytes The size of the old generation after marking
+ */
+double GarbageCollector::heap_growth_factor(size_t live_bytes) const {
+    if (live_bytes >= config_.heap_growth_live_size) {
+        return config_.min_heap_growth;
+    }
+
+    auto fraction = static_cast<double>(live_bytes) / config_.heap_growth_live_size;
+    return config_.max_heap_growth - (config_.max_heap_growth - config_.min_heap_growth) * fraction;
+}
+
+/**
+ * Start counting allocations towards the next collection. An incremental
+ * mark in progress gets several slices per budget, so it keeps up with
+ * the mutator.
+ */
+void GarbageCollector::reset_allocation_budget() {
+    auto budget = config_.allocation_budget;
+    if (marking_) {
+        budget /= kMarkSlicesPerBudget;
+    }
+
+    rt_gc_allocation_budget = static_cast<int64_t>(budget);
+    rt_gc_requested         = 0;
+}
+
+/**
+ * Collect the young generation only. The roots are the stack, the registered
+ * roots, the current exception and the remembered set.
+ * @param stackPointer The stack pointer of the call point
+ */
+void GarbageCollector::collect_minor(void* stackPointer) {
+    assert(is_owner_thread());
+    CollectionScope scope(collection_lock_, collection_depth_);
+
+    auto              start = std::chrono::steady_clock::now();
+    GCCollectionStats collection;
+
+    scan_conservative_roots(stackPointer, false);
+    evacuate_young(stackPointer, false, collection);
+
+    collection.mark_us = microseconds_since(start);
+    record_collection(collection);
+}
+
+/**
+ * Collect the whole heap. The nursery is emptied into the old generation
+ * first, then the old generation is marked. Old space pages are swept
+ * lazily as they are needed for allocation.
+ * @param stackPointer The stack pointer of the call point
+ */
+void GarbageCollector::collect_major(void* stackPointer) {
+    assert(is_owner_thread());
+    CollectionScope scope(collection_lock_, collection_depth_);
+
+    if (marking_) {
+        // Finish the incremental cycle in this pause
+        collect_minor(stackPointer);
+        mark_slice(std::chrono::steady_clock::time_point::max());
+        finish_incremental_mark(stackPointer);
+        return;
+    }
+
+    auto start   = std::chrono::steady_clock::now();
+    major_stats_ = GCCollectionStats();
+
+    mark_roots(stackPointer);
+
+    // Mark everything reachable from the roots
+    marked_old_bytes_ = marker_.mark(mark_roots_, mark_visitor_);
+    mark_roots_.clear();
+    major_stats_.mark_us += microseconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    compact(stackPointer);
+    major_stats_.sweep_us += microseconds_since(start);
+
+    finish_major();
+}
+
+/**
+ * Empty the nursery and mark the roots of a major collection, leaving them
+ * in mark_roots_ to be scanned.
+ */
+void GarbageCollector::mark_roots(void* stackPointer) {
+    // Pages still holding marks from the previous cycle must be swept first
+    old_space_.finish_sweep();
+
+    scan_conservative_roots(stackPointer, true);
+    evacuate_young(stackPointer, true, major_stats_);
+
+    visit_stack_frames(stackPointer, [this](frame_info_t* frame_info, uintptr_t frame_base) {
+      for (uint16_t i = 0; i < frame_info->numSlots; i++) {
+          auto pointerSlot = frame_info->slots[i];
+          if (pointerSlot.kind >= 0) {
+              continue;
+          }
+
+          auto ptr = reinterpret_cast<void**>(frame_base + pointerSlot.offset);
+          add_mark_root(*ptr);
+      }
+    });
+
+    visit_value_roots([this](void* root) {
+      add_mark_root(root);
+    });
+}
+
+/**
+ * Find the heap objects referenced from the parts of the C stack that have
+ * no stack map. Every word that points into an object is taken to be a
+ * reference to it, so these objects are kept alive and never moved.
+ *
+ * From a statepoint, that is every frame above the compiled frames the
+ * stack maps describe. Lisp calls go through the runtime, so compiled
+ * frames further up can only be found by scanning through the runtime
+ * frames between them. Without a statepoint the whole stack is scanned,
+ * including callee saved registers, if the collector scans conservatively.
+ * @param stackPointer The stack pointer of the call point, or nullptr
+ * @param include_old Also look for old objects. Old space must be swept.
+ */
+__attribute__((noinline, no_sanitize_address))
+void GarbageCollector::scan_conservative_roots(void* stackPointer, bool include_old) {
+    conservative_roots_.clear();
+
+    std::jmp_buf registers;
+    uintptr_t    low;
+
+    if (stackPointer != nullptr) {
+        low = visit_stack_frames(stackPointer, [](frame_info_t*, uintptr_t) {});
+    }
+    else if (conservative_stack_) {
+        // Spill the callee saved registers into this frame
+        setjmp(registers);
+        low = reinterpret_cast<uintptr_t>(&registers);
+    }
+    else {
+        return;
+    }
+
+    low &= ~static_cast<uintptr_t>(sizeof(void*) - 1);
+    auto high = current_stack_top();
+
+    for (auto slot = low; slot < high; slot += sizeof(void*)) {
+        auto word = *reinterpret_cast<void**>(slot);
+
+        if (!include_old && !nursery_.in_region(word)) {
+            continue;
+        }
+
+        auto obj = find_object(word);
+        if (obj != nullptr) {
+            conservative_roots_.push_back(OBJECT_TO_TAG(obj));
+        }
+    }
+
+    std::sort(conservative_roots_.begin(), conservative_roots_.end());
+    conservative_roots_.erase(std::unique(conservative_roots_.begin(), conservative_roots_.end()),
+                              conservative_roots_.end());
+}
+
+/**
+ * @return The start of the heap object containing ptr, or nullptr
+ */
+void* GarbageCollector::find_object(void* ptr) const {
+    if (nursery_.in_region(ptr)) {
+        auto start = nursery_.object_start(ptr);
+        if (start == nullptr) {
+            return nullptr;
+        }
+
+        auto size = object_size(static_cast<EObjectHeader*>(start));
+        return static_cast<uint8_t*>(ptr) < static_cast<uint8_t*>(start) + size ? start : nullptr;
+    }
+
+    auto cell = old_space_.find_cell(ptr);
+    if (cell != nullptr) {
+        return cell;
+    }
+
+    return large_space_.find_object(ptr);
+}
+
+/**
+ * Move the live objects out of sparsely occupied old space pages, so the
+ * sweep can return those pages to the pool. Runs between marking and
+ * sweeping, while the mutator is stopped.
+ *
+ * Objects referenced by registered roots, pins, the root stack or the
+ * exception in flight are held by raw pointer, so their pages are never
+ * evacuated. Neither are the pages of objects found by the conservative
+ * scan, which covers every frame the stack maps do not describe. Every
+ * other reference is updated: stack slots through the stack map, fields
+ * of every marked object, the remembered set and the intern table.
+ * @param stackPointer The stack pointer of the call point
+ */
+void GarbageCollector::compact(void* stackPointer) {
+    if (config_.evacuation_threshold <= 0) {
+        return;
+    }
+
+    std::unordered_set<Page*> pinned_pages;
+    auto pin_page = [&pinned_pages, this](void* root) {
+      if (is_object(root) && !nursery_.in_region(root)) {
+          pinned_pages.insert(PageAllocator::page_of(TAG_TO_OBJECT(root)));
+      }
+    };
+
+    visit_value_roots(pin_page);
+
+    auto pages = old_space_.begin_evacuation(config_.evacuation_threshold, [&](Page* page) {
+      return pinned_pages.count(page) != 0;
+    });
+
+    if (pages.empty()) {
+        return;
+    }
+
+    // Copy the live objects, leaving a forwarding pointer behind
+    for (auto page: pages) {
+        PageAllocator::for_each_marked_cell(page, [this](void* cell) {
+          auto header = static_cast<EObjectHeader*>(cell);
+          auto size   = object_size(header);
+          auto copy   = old_space_.allocate(size);
+
+          memcpy(copy, header, size);
+          PageAllocator::mark(copy);
+
+          header->gc_mark |= kGCForwardedBit;
+          *reinterpret_cast<void**>(header + 1) = OBJECT_TO_TAG(copy);
+        });
+    }
+
+    auto forward = [this](void* value) -> void* {
+      if (!is_object(value) || nursery_.in_region(value)) {
+          return value;
+      }
+
+      auto header = TAG_TO_OBJECT(value);
+      if (PageAllocator::page_of(header)->evacuating && (header->gc_mark & kGCForwardedBit)) {
+          return *reinterpret_cast<void**>(header + 1);
+      }
+
+      return value;
+    };
+
+    auto update_fields = [&](void* obj) {
+      visit_pointer_fields(static_cast<EObjectHeader*>(obj), [&](void** field) {
+        *field = forward(*field);
+      });
+    };
+
+    // Derived pointers are shifted by the distance their base moved
+    std::vector<intptr_t> base_deltas;
+    visit_stack_frames(stackPointer, [&](frame_info_t* frame_info, uintptr_t frame_base) {
+      base_deltas.assign(frame_info->numSlots, 0);
+
+      for (uint16_t i = 0; i < frame_info->numSlots; i++) {
+          auto pointerSlot = frame_info->slots[i];
+          auto ptr         = reinterpret_cast<void**>(frame_base + pointerSlot.offset);
+
+          if (pointerSlot.kind < 0) {
+              auto old_value = *ptr;
+              *ptr = forward(old_value);
+              base_deltas[i] = reinterpret_cast<intptr_t>(*ptr) - reinterpret_cast<intptr_t>(old_value);
+          }
+          else {
+              *ptr = reinterpret_cast<void*>(reinterpret_cast<intptr_t>(*ptr) + base_deltas[pointerSlot.kind]);
+          }
+      }
+    });
+
+    old_space_.for_each_marked(update_fields);
+    large_space_.for_each_marked(update_fields);
+    nursery_.for_each_marked(update_fields);
+
+    for (auto& obj: remembered_set_) {
+        obj = TAG_TO_OBJECT(forward(OBJECT_TO_TAG(obj)));
+    }
+
+    interned_.update(forward);
+
+    old_space_.end_evacuation(pages);
+}
+
+/**
+ * Keep an object alive and at the same address until it is unpinned, so
+ * native code can hold a raw pointer to it. Pins nest.
+ */
+void GarbageCollector::pin(void* obj) {
+    assert(is_owner_thread());
+    if (is_object(obj)) {
+        pin_counts_[obj]++;
+    }
+}
+
+void GarbageCollector::unpin(void* obj) {
+    assert(is_owner_thread());
+    auto it = pin_counts_.find(obj);
+    if (it != pin_counts_.end() && --it->second == 0) {
+        pin_counts_.erase(it);
+    }
+}
+
+/**
+ * @return The interned symbol or keyword with the name, or nullptr
+ */
+void* GarbageCollector::find_interned(uint32_t tag, const char* name, size_t length) {
+    auto value = interned_.find(tag, name, length);
+
+    // The table does not keep names alive, so an incremental mark may not have reached it
+    if (value != nullptr && marking_) {
+        shade(value);
+    }
+
+    return value;
+}
+
+/**
+ * Intern a symbol or keyword allocated with malloc_old(), unless another
+ * thread has interned the name first.
+ * @return The interned object
+ */
+void* GarbageCollector::intern(void* value) {
+    auto interned = interned_.insert(value);
+    if (interned != value && marking_) {
+        shade(interned);
+    }
+
+    return interned;
+}
+
+/**
+ * Free everything the mark phase did not reach
+ */
+void GarbageCollector::finish_major() {
+    auto start = std::chrono::steady_clock::now();
+    marking_ = false;
+
+    // Take the census of the old generation while the marks are still set
+    size_t live_objects     = 0;
+    auto   count_live       = [this, &live_objects](void* obj) {
+      auto header = static_cast<EObjectHeader*>(obj);
+      major_stats_.live_bytes_by_type[header->tag % kMaxObjectTypes] += object_size(header);
+      live_objects++;
+    };
+    old_space_.for_each_marked(count_live);
+    large_space_.for_each_marked(count_live);
+    nursery_.for_each_marked([this, &count_live](void* obj) {
+      if (nursery_.in_tenured_block(obj)) {
+          count_live(obj);
+      }
+    });
+
+    // Dead objects must leave the remembered set before they are freed
+    auto remembered_end = std::remove_if(remembered_set_.begin(), remembered_set_.end(), [this](void* obj) {
+      return !is_marked(obj);
+    });
+    remembered_set_.erase(remembered_end, remembered_set_.end());
+
+    // Names are interned weakly, so drop the dead ones too
+    interned_.update([this](void* value) -> void* {
+      return is_marked(TAG_TO_OBJECT(value)) ? value : nullptr;
+    });
+
+    sweep_heap();
+
+    nursery_.sweep_tenured_blocks([this](void* obj) {
+      return nursery_.is_marked(obj);
+    });
+    nursery_.clear_marks();
+
+    // Everything that was not marked is garbage, even if it has not been swept yet
+    major_stats_.objects_freed += old_objects_ - std::min(old_objects_, live_objects);
+    major_stats_.bytes_freed   += old_space_bytes_ - std::min(old_space_bytes_, marked_old_bytes_);
+    major_stats_.sweep_us      += microseconds_since(start);
+    major_stats_.major          = true;
+    record_collection(major_stats_);
+
+    stats_.live_bytes     = marked_old_bytes_;
+    old_objects_          = live_objects;
+    old_space_bytes_      = marked_old_bytes_;
+    auto grown_size       = static_cast<size_t>(old_space_bytes_ * heap_growth_factor(old_space_bytes_));
+    next_major_threshold_ = std::max(config_.major_collection_threshold, grown_size);
+}
+
+/**
+ * @return The size of the heap in bytes: the nursery, plus every old object
+ * allocated since the last major collection or found live by it
+ */
+size_t GarbageCollector::heap_size() const {
+    return nursery_.size() + old_space_bytes_;
+}
+
+/** @return True if the heap has grown past GCConfig::soft_heap_limit */
+bool GarbageCollector::over_soft_limit() const {
+    return config_.soft_heap_limit != 0 && heap_size() > config_.soft_heap_limit;
+}
+
+/**
+ * Throw an electrum.out-of-memory exception into the mutator
+ */
+void GarbageCollector::out_of_memory() {
+    // The exception itself has to be allocated past the limit
+    allocating_out_of_memory_ = true;
+    auto exception = el_rt_allocate_exception("electrum.out-of-memory", "Heap limit exceeded", NIL_PTR);
+    allocating_out_of_memory_ = false;
+
+    el_rt_throw(exception);
+}
+
+/**
+ * Begin an incremental major collection. The heap is marked from a
+ * snapshot taken now: the roots are marked in this pause, and while
+ * marking the write barrier shades every reference that is overwritten
+ * (Yuasa's deletion barrier). Objects promoted or allocated in the old
+ * generation while marking are allocated black.
+ *
+ * The nursery is emptied first, so the only young objects in the snapshot
+ * are pinned roots. Their fields are scanned now, and young objects are
+ * never queued, as minor collections may move them while marking.
+ */
+void GarbageCollector::start_incremental_mark(void* stackPointer) {
+    auto start   = std::chrono::steady_clock::now();
+    major_stats_ = GCCollectionStats();
+
+    mark_roots(stackPointer);
+    marked_old_bytes_ = 0;
+
+    std::vector<EObjectHeader*> young_objects;
+
+    for (auto root: mark_roots_) {
+        if (nursery_.contains(root)) {
+            young_objects.push_back(root);
+        }
+        else {
+            grey_stack_.push_back(root);
+        }
+    }
+    mark_roots_.clear();
+
+    while (!young_objects.empty()) {
+        auto obj = young_objects.back();
+        young_objects.pop_back();
+
+        visit_pointer_fields(obj, [&](void** field) {
+          if (!is_object(*field)) {
+              return;
+          }
+
+          auto child = TAG_TO_OBJECT(*field);
+          if (nursery_.contains(child)) {
+              if (nursery_.mark(child)) {
+                  young_objects.push_back(child);
+              }
+          }
+          else {
+              shade(*field);
+          }
+        });
+    }
+
+    marking_ = true;
+    major_stats_.mark_us += microseconds_since(start);
+}
+
+/**
+ * Scan grey objects until there are none left or the deadline passes
+ * @return True if marking is complete
+ */
+bool GarbageCollector::mark_slice(std::chrono::steady_clock::time_point deadline) {
+    auto   start   = std::chrono::steady_clock::now();
+    size_t scanned = 0;
+
+    while (!grey_stack_.empty()) {
+        auto obj = grey_stack_.back();
+        grey_stack_.pop_back();
+
+        if (!grey_stack_.empty()) {
+            __builtin_prefetch(grey_stack_.back());
+        }
+
+        marked_old_bytes_ += object_size(obj);
+
+        visit_pointer_fields(obj, [this](void** field) {
+          shade(*field);
+        });
+
+        if (++scanned % kMarkSliceCheckInterval == 0 && std::chrono::steady_clock::now() >= deadline) {
+            major_stats_.mark_us += microseconds_since(start);
+            return false;
+        }
+    }
+
+    major_stats_.mark_us += microseconds_since(start);
+    return true;
+}
+
+/**
+ * End an incremental cycle whose marking is done, compacting the old
+ * generation in this final pause like a non-incremental one. Compaction
+ * only updates the fields of marked objects, so the nursery is emptied
+ * first, leaving only the young objects that are pinned, which are marked.
+ * Old objects held by frames without a stack map must be found as well.
+ * @param stackPointer The stack pointer of the call point
+ */
+void GarbageCollector::finish_incremental_mark(void* stackPointer) {
+    if (config_.evacuation_threshold > 0) {
+        auto start = std::chrono::steady_clock::now();
+
+        scan_conservative_roots(stackPointer, true);
+        evacuate_young(stackPointer, true, major_stats_);
+
+        visit_value_roots([this](void* root) {
+          if (is_object(root) && nursery_.contains(root)) {
+              mark(TAG_TO_OBJECT(root));
+          }
+        });
+
+        compact(stackPointer);
+        major_stats_.sweep_us += microseconds_since(start);
+    }
+
+    finish_major();
+}
+
+/**
+ * Mark an old object grey during incremental marking. Young objects are
+ * ignored, as the nursery is never swept by a major collection.
+ */
+void GarbageCollector::shade(void* obj) {
+    if (!is_object(obj) || nursery_.contains(obj)) {
+        return;
+    }
+
+    auto header = TAG_TO_OBJECT(obj);
+    if (mark(header)) {
+        grey_stack_.push_back(header);
+    }
+}
+
+/**
+ * Mark an object that became old while an incremental mark is running
+ */
+void GarbageCollector::allocate_black(void* obj, size_t size) {
+    mark(obj);
+    marked_old_bytes_ += size;
+}
+
+/**
+ * Copy every live object out of the nursery.
+ * @param stackPointer The stack pointer of the call point
+ * @param promote_all Promote all survivors, regardless of their age
+ */
+void GarbageCollector::evacuate_young(void* stackPointer, bool promote_all, GCCollectionStats& collection) {
+    // Read the types of sampled objects before they move
+    profiler_.resolve_samples();
+
+    size_t allocated_bytes = 0;
+    retire_allocation_buffers(young_objects_, allocated_bytes);
+    young_bytes_ += allocated_bytes;
+    stats_.bytes_allocated += allocated_bytes;
+
+    survivor_objects_       = 0;
+    survivor_bytes_         = 0;
+    young_survivor_objects_ = 0;
+    young_survivor_bytes_   = 0;
+
+    nursery_.begin_collection();
+
+    // Registered roots, pins and the root stack are referenced by value from
+    // places we can't update, and the unwinder holds the address of the
+    // exception in flight, so none of these may move.
+    auto pin_young = [this](void* root) {
+      if (!is_object(root) || !nursery_.in_from_space(root)) {
+          return;
+      }
+
+      auto header = TAG_TO_OBJECT(root);
+      if (header->gc_mark & kGCPinnedBit) {
+          return;
+      }
+
+      header->gc_mark |= kGCPinnedBit;
+      nursery_.pin(header);
+      count_survivor(header, true);
+      pinned_objects_.push_back(header);
+      grey_objects_.push_back(header);
+    };
+
+    visit_value_roots(pin_young);
+
+    // Stack slots can be updated in place. All base pointers come before
+    // derived pointers, so relocate the bases first and then shift each
+    // derived pointer by the distance its base moved.
+    std::vector<intptr_t> base_deltas;
+    visit_stack_frames(stackPointer, [&](frame_info_t* frame_info, uintptr_t frame_base) {
+      base_deltas.assign(frame_info->numSlots, 0);
+
+      for (uint16_t i = 0; i < frame_info->numSlots; i++) {
+          auto pointerSlot = frame_info->slots[i];
+          auto ptr         = reinterpret_cast<void**>(frame_base + pointerSlot.offset);
+
+          if (pointerSlot.kind < 0) {
+              auto old_value = *ptr;
+              *ptr = evacuate(old_value, promote_all);
+              base_deltas[i] = reinterpret_cast<intptr_t>(*ptr) - reinterpret_cast<intptr_t>(old_value);
+          }
+          else {
+              *ptr = reinterpret_cast<void*>(reinterpret_cast<intptr_t>(*ptr) + base_deltas[pointerSlot.kind]);
+          }
+      }
+    });
+
+    // Old objects that may point into the nursery. Clear the flags first, so
+    // that the objects which still hold young references are remembered again.
+    retire_old_allocations();
+
+    std::vector<void*> remembered;
+    {
+        std::lock_guard<std::mutex> lock(remembered_lock_);
+        remembered.swap(remembered_set_);
+    }
+
+    for (auto obj: remembered) {
+        __atomic_fetch_and(&static_cast<EObjectHeader*>(obj)->gc_mark, ~kGCRememberedBit, __ATOMIC_RELAXED);
+    }
+
+    for (auto obj: remembered) {
+        scan_young_fields(obj, promote_all);
+    }
+
+    while (!grey_objects_.empty()) {
+        auto obj = grey_objects_.back();
+        grey_objects_.pop_back();
+        scan_young_fields(obj, promote_all);
+    }
+
+    for (auto obj: pinned_objects_) {
+        static_cast<EObjectHeader*>(obj)->gc_mark &= ~kGCPinnedBit;
+    }
+    pinned_objects_.clear();
+
+    // Blocks that have been pinned for too long are promoted in place. Their
+    // objects are now old, so any young objects they refer to must be remembered.
+    for (auto obj: nursery_.end_collection(config_.tenure_age)) {
+        auto header = static_cast<EObjectHeader*>(obj);
+        old_space_bytes_ += object_size(header);
+        old_objects_++;
+
+        young_survivor_objects_--;
+        young_survivor_bytes_ -= align_object_size(object_size(header));
+
+        if (marking_) {
+            allocate_black(header, object_size(header));
+        }
+
+        visit_pointer_fields(header, [this, header](void** field) {
+          if (is_object(*field) && nursery_.contains(*field)) {
+              remember(header);
+          }
+        });
+    }
+
+    // Everything in the nursery that did not survive is garbage
+    assert(survivor_objects_ <= young_objects_ && survivor_bytes_ <= young_bytes_);
+    collection.objects_freed += young_objects_ - survivor_objects_;
+    collection.bytes_freed   += young_bytes_ - survivor_bytes_;
+
+    young_objects_ = young_survivor_objects_;
+    young_bytes_   = young_survivor_bytes_;
+}
+
+/**
+ * Count an object that survived the current minor collection
+ * @param young True if the object stays in the nursery
+ */
+void GarbageCollector::count_survivor(void* obj, bool young) {
+    auto size = align_object_size(object_size(static_cast<EObjectHeader*>(obj)));
+
+    survivor_objects_++;
+    survivor_bytes_ += size;
+
+    if (young) {
+        young_survivor_objects_++;
+        young_survivor_bytes_ += size;
+    }
+}
+
+/**
+ * Add a finished collection to the totals
+ */
+void GarbageCollector::record_collection(const GCCollectionStats& collection) {
+    if (collection.major) {
+        stats_.major_collections++;
+    }
+    else {
+        stats_.minor_collections++;
+    }
+
+    stats_.objects_freed += collection.objects_freed;
+    stats_.bytes_freed += collection.bytes_freed;
+    stats_.last_collection = collection;
+}
+
+/**
+ * Copy the statistics from any thread, waiting for a collection in
+ * progress on the owning thread to finish
+ */
+GCStats GarbageCollector::copy_stats() {
+    AllocationScope scope(collection_lock_, is_owner_thread());
+    return stats_;
+}
+
+/**
+ * Move a young object out of from-space, either into a survivor block or
+ * into the old generation.
+ * @return The new location of the object, or obj if it did not move
+ */
+void* GarbageCollector::evacuate(void* obj, bool promote_all) {
+    if (!is_object(obj) || !nursery_.in_from_space(obj)) {
+        return obj;
+    }
+
+    auto header = TAG_TO_OBJECT(obj);
+
+    if (header->gc_mark & kGCForwardedBit) {
+        return *reinterpret_cast<void**>(header + 1);
     }
-}
 
-GarbageCollector::~GarbageCollector() {
-    // Free all heap objects
-    for (auto ptr: heap_objects_) {
-        auto header = TAG_TO_OBJECT(ptr);
-        this->free(header);
+    // Pinned objects were queued for scanning when they were pinned
+    if (header->gc_mark & kGCPinnedBit) {
+        return obj;
     }
-}
 
-void GarbageCollector::init_stackmap(void* stackmap) {
-    statepoint_tables_.push_back(generate_table(stackmap, 0.5));
-}
+    auto size = object_size(header);
+    auto age  = ((header->gc_mark & kGCAgeMask) >> kGCAgeShift) + 1;
 
-frame_info_t* GarbageCollector::get_frame_info(uint64_t return_address) {
-    for (auto statepoint_table: statepoint_tables_) {
-        auto f_info = lookup_return_address(statepoint_table, return_address);
-        if (f_info) {
-            return f_info;
-        }
+    void* copy = nullptr;
+    if (!promote_all && age < config_.tenure_age) {
+        copy = nursery_.allocate_survivor(size);
     }
 
-    return nullptr;
+    count_survivor(header, copy != nullptr);
+
+    if (copy == nullptr) {
+        copy = old_space_allocate(size);
+    }
+
+    memcpy(copy, header, size);
+
+    auto copy_header = static_cast<EObjectHeader*>(copy);
+    copy_header->gc_mark = (std::min(age, 0xFFU) << kGCAgeShift) & kGCAgeMask;
+
+    // Leave a forwarding pointer in the first word after the header. Every
+    // object has at least one word of payload.
+    auto tagged = OBJECT_TO_TAG(copy);
+    header->gc_mark |= kGCForwardedBit;
+    *reinterpret_cast<void**>(header + 1) = tagged;
+
+    grey_objects_.push_back(copy);
+    return tagged;
 }
 
 /**
- * Maybe perform a garbage collection pass
- * @param stackPointer The stack pointer of the call point
+ * Evacuate the young objects referenced by obj, updating its fields.
  */
-void GarbageCollector::collect(void* stackPointer) {
+void GarbageCollector::scan_young_fields(void* obj, bool promote_all) {
+    auto header    = static_cast<EObjectHeader*>(obj);
+    bool has_young = false;
 
-    auto return_address = *static_cast<uint64_t*>(stackPointer);
-
-    auto frame_info = get_frame_info(return_address);
-
-    auto stackIndex = reinterpret_cast<uintptr_t>(stackPointer);
-    stackIndex += sizeof(void*);
+    visit_pointer_fields(header, [&](void** field) {
+      *field = evacuate(*field, promote_all);
 
-    while (frame_info != nullptr) {
-        for (uint16_t i = 0; i < frame_info->numSlots; i++) {
-            auto pointerSlot = frame_info->slots[i];
-            if (pointerSlot.kind >= 0) {
-                continue;
-            }
+      if (is_object(*field) && nursery_.contains(*field)) {
+          has_young = true;
+      }
+    });
 
-            auto ptr = reinterpret_cast<void**>(stackIndex + pointerSlot.offset);
+    if (has_young && !nursery_.contains(header)) {
+        remember(header);
+    }
+}
 
-            // Mark if it is an object
-            if (is_object(*ptr)) {
-                traverse_object(*ptr);
-            }
-        }
+/**
+ * Add an old object to the remembered set, unless it is already there.
+ * Safe to call from the write barriers of several threads at once.
+ */
+void GarbageCollector::remember(void* obj) {
+    auto header = TAG_TO_OBJECT(obj);
 
-        // Move to next frame
-        stackIndex     = stackIndex + frame_info->frameSize;
-        return_address = *reinterpret_cast<uint64_t*>(stackIndex);
-        stackIndex += sizeof(void*);
-        frame_info     = get_frame_info(return_address);
-    };
-    // Mark roots
-    for (auto it: object_roots_) {
-        if (is_object(it)) {
-            traverse_object(it);
-        }
+    if (__atomic_load_n(&header->gc_mark, __ATOMIC_RELAXED) & kGCRememberedBit) {
+        return;
     }
 
-    if(is_object(current_exception)) {
-        traverse_object(current_exception);
+    // Only the thread that sets the flag adds the object
+    if (__atomic_fetch_or(&header->gc_mark, kGCRememberedBit, __ATOMIC_RELAXED) & kGCRememberedBit) {
+        return;
     }
 
-    sweep_heap();
+    std::lock_guard<std::mutex> lock(remembered_lock_);
+    remembered_set_.push_back(header);
 }
 
-void GarbageCollector::traverse_object(void* vobj) {
-    auto obj = TAG_TO_OBJECT(vobj);
+/**
+ * Remember every object allocated old since the last collection, now that
+ * their headers have been written, and count them as allocated. Only
+ * called during a collection, while no other thread allocates.
+ */
+void GarbageCollector::retire_old_allocations() {
+    for (auto obj: allocated_old_) {
+        remember(obj);
+    }
+    allocated_old_.clear();
 
-    // Skip if the object has already been seen
-    if (obj->gc_mark) {
-        return;
+    stats_.bytes_allocated += allocated_old_bytes_;
+    allocated_old_bytes_ = 0;
+}
+
+/**
+ * Set the mark bit of an object, in the side bitmap of the space it lives
+ * in. Safe to call from several marking threads at once.
+ * @return True if the object was not already marked
+ */
+inline bool GarbageCollector::mark(const void* obj) {
+    if (nursery_.in_region(obj)) {
+        return nursery_.mark(obj);
     }
 
-    std::vector<EObjectHeader*> st;
-    st.push_back(obj);
+    return PageAllocator::mark(obj);
+}
 
-    while (!st.empty()) {
-        obj = st.back();
-        st.pop_back();
+bool GarbageCollector::is_marked(const void* obj) const {
+    if (nursery_.in_region(obj)) {
+        return nursery_.is_marked(obj);
+    }
 
-        if (obj->gc_mark) {
-            return;
-        }
+    return PageAllocator::is_marked(obj);
+}
+
+/**
+ * Mark a root object, and queue it to be scanned by the next mark phase
+ */
+void GarbageCollector::add_mark_root(void* root) {
+    if (is_object(root) && mark(TAG_TO_OBJECT(root))) {
+        mark_roots_.push_back(TAG_TO_OBJECT(root));
+    }
+}
 
-        // Mark this object
-        obj->gc_mark = 1;
+/**
+ * Mark an object and everything reachable from it
+ */
+void GarbageCollector::traverse_object(void* vobj) {
+    add_mark_root(vobj);
+    marked_old_bytes_ += marker_.mark(mark_roots_, mark_visitor_);
+    mark_roots_.clear();
+}
 
-        switch (obj->tag) {
-        case kETypeTagFloat:break;
-        case kETypeTagKeyword:break;
-        case kETypeTagString:break;
-        case kETypeTagSymbol:break;
+/**
+ * Allocate garbage collected memory
+ * @param size The size of the memory block to allocate
+ * @return A pointer to the allocated memory
+ */
+void* GarbageCollector::malloc(size_t size) {
+    // TODO: Place in heap list
+    return std::malloc(size);
+}
 
-        case kETypeTagPair: {
-            auto pair = reinterpret_cast<EPair*>(reinterpret_cast<void*>(obj));
+/**
+ * Allocate garbage collected memory. Assumes that the pointer will
+ * be tagged. Small objects are bump allocated from the calling thread's
+ * allocation buffer, so any number of threads may allocate at once.
+ * @param size The size of the memory block to allocate
+ * @return A pointer to the allocated memory
+ */
+void* GarbageCollector::malloc_tagged_object(size_t size) {
+    auto& thread_buffer = thread_allocation_buffer;
 
-            if (is_object(pair->value)) {
-                st.push_back(TAG_TO_OBJECT(pair->value));
-            }
+    // Large objects skip the nursery, so they are never copied. The flag is
+    // set before checking for a collection, which sets its own flag before
+    // waiting for ours, so one of the two sees the other.
+    if (size <= kMaxSmallObjectSize) {
+        thread_buffer.bumping.store(true);
+        if (!collection_running.load()) {
+            auto ptr = nursery_.allocate(thread_buffer.buffer, size);
+            thread_buffer.bumping.store(false, std::memory_order_release);
 
-            if (is_object(pair->next)) {
-                st.push_back(TAG_TO_OBJECT(pair->next));
+            if (ptr != nullptr) {
+                return ptr;
             }
-
-            break;
+        } else {
+            thread_buffer.bumping.store(false, std::memory_order_release);
         }
+    }
 
-        case kETypeTagVar: {
-            auto var = reinterpret_cast<EVar*>(reinterpret_cast<void*>(obj));
+    return malloc_slow(thread_buffer.buffer, size);
+}
 
-            if (is_object(var->sym)) {
-                st.push_back(TAG_TO_OBJECT(var->sym));
-            }
+/**
+ * Allocate an object that does not fit below the limit of the thread's
+ * allocation buffer, taking an allocation sample when it is due.
+ */
+void* GarbageCollector::malloc_slow(AllocationBuffer& buffer, size_t size) {
+    AllocationScope scope(collection_lock_, is_owner_thread());
+    auto            interval = profiler_.interval();
+    auto sample   = false;
 
-            if (is_object(var->val)) {
-                st.push_back(TAG_TO_OBJECT(var->val));
-            }
+    if (interval != 0) {
+        // Count the bytes bump allocated since the limit was set, then this object
+        if (buffer.bytes_to_sample == 0) {
+            buffer.bytes_to_sample = static_cast<int64_t>(interval);
+        }
+        buffer.bytes_to_sample -= (buffer.cursor - buffer.sample_base) + static_cast<int64_t>(size);
 
-            break;
+        if (buffer.bytes_to_sample <= 0) {
+            sample = true;
+            buffer.bytes_to_sample = static_cast<int64_t>(interval);
         }
+    }
 
-        case kETypeTagFunction: {
-            auto fn = reinterpret_cast<ECompiledFunction*>(reinterpret_cast<void*>(obj));
+    // The object may fit in the buffer if its limit was lowered for sampling
+    buffer.limit = buffer.end;
+    auto ptr = allocate_slow(buffer, size);
 
-            for (uint64_t i = 0; i < fn->env_size; i++) {
-                auto e = fn->env[i];
-                if (is_object(e)) {
-                    st.push_back(TAG_TO_OBJECT(e));
-                }
-            }
+    if (sample) {
+        profiler_.sample(ptr, size, stack_maps_);
+    }
+
+    buffer.sample_base = buffer.cursor;
+    if (interval != 0) {
+        buffer.limit = buffer.cursor + std::min<int64_t>(buffer.end - buffer.cursor, buffer.bytes_to_sample);
+    }
 
-            break;
+    return ptr;
+}
+
+/**
+ * Allocate an object outside of the thread's allocation buffer, taking a new
+ * buffer from the nursery for small objects.
+ */
+void* GarbageCollector::allocate_slow(AllocationBuffer& buffer, size_t size) {
+    if (size <= kMaxSmallObjectSize) {
+        auto ptr = nursery_.allocate(buffer, size);
+        if (ptr != nullptr) {
+            return ptr;
         }
 
-        case kETypeTagInterpretedFunction: {
-            auto fn = reinterpret_cast<EInterpretedFunction*>(reinterpret_cast<void*>(obj));
+        charge_allocation(kNurseryBlockSize);
 
-            break;
+        if (nursery_.refill(buffer)) {
+            return nursery_.allocate(buffer, size);
         }
 
-        case kETypeTagException: {
-            auto exc = reinterpret_cast<ElectrumException*>(reinterpret_cast<void*>(obj));
-            if(is_object(exc->metadata)) {
-                st.push_back(TAG_TO_OBJECT(exc->metadata));
+        request_collection();
+
+        if (conservative_stack_ && is_owner_thread()) {
+            collect(nullptr);
+
+            if (nursery_.refill(buffer)) {
+                return nursery_.allocate(buffer, size);
             }
-            break;
         }
+    }
+    else {
+        charge_allocation(size);
+    }
 
-        default:break;
-        }
+    // Large objects, or objects allocated while the nursery is full, go
+    // straight into the old generation. A full nursery also asks for a
+    // collection at the next safepoint.
+    return allocate_old(size);
+}
+
+/**
+ * Allocate an object in the old generation, where it will not be moved by
+ * minor collections. Charged to the allocation budget like any other.
+ */
+void* GarbageCollector::malloc_old(size_t size) {
+    AllocationScope scope(collection_lock_, is_owner_thread());
+    charge_allocation(size);
+    return allocate_old(size);
+}
+
+/**
+ * Allocate an object in the old generation from any thread. Its fields are
+ * initialised without a write barrier, so it is remembered at the next
+ * collection.
+ */
+void* GarbageCollector::allocate_old(size_t size) {
+    std::unique_lock<std::mutex> lock(old_space_lock_);
+
+    if (config_.hard_heap_limit != 0 && heap_size() + size > config_.hard_heap_limit && !allocating_out_of_memory_) {
+        // Allocating the exception may come back here
+        lock.unlock();
+        out_of_memory();
     }
 
+    auto ptr = old_space_allocate(size);
+    allocated_old_.push_back(ptr);
+    allocated_old_bytes_ += size;
+    return ptr;
 }
 
 /**
- * Allocate garbage collected memory
- * @param size The size of the memory block to allocate
- * @return A pointer to the allocated memory
+ * Count an allocation against the budget, asking for a collection once it
+ * is spent.
  */
-void* GarbageCollector::malloc(size_t size) {
-    // TODO: Place in heap list
-    return std::malloc(size);
+void GarbageCollector::charge_allocation(size_t size) {
+    if (__atomic_sub_fetch(&rt_gc_allocation_budget, static_cast<int64_t>(size), __ATOMIC_RELAXED) <= 0) {
+        request_collection();
+
+        // Without safepoints, the stack scan lets us collect right here.
+        // Other threads leave the collection to the owner.
+        if (conservative_stack_ && is_owner_thread()) {
+            collect(nullptr);
+        }
+    }
 }
 
 /**
- * Allocate garbage collected memory. Assumes that the pointer will
- * be tagged.
- * @param size The size of the memory block to allocate
+ * Allocate an object in the old generation
+ * @param size The size of the object, including its header
  * @return A pointer to the allocated memory
  */
-void* GarbageCollector::malloc_tagged_object(size_t size) {
-    auto ptr = std::malloc(size);
-    /* The object will be tagged by the runtime, so add the tag to the
-     * pointer for faster lookup later.
-     */
-    heap_objects_.push_back(OBJECT_TO_TAG(ptr));
+void* GarbageCollector::old_space_allocate(size_t size) {
+    void* ptr;
+    if (size <= kMaxSmallObjectSize) {
+        ptr = old_space_.allocate(size);
+    }
+    else {
+        ptr = large_space_.allocate(size);
+    }
+
+    old_space_bytes_ += size;
+    old_objects_++;
+
+    if (marking_) {
+        allocate_black(ptr, size);
+    }
+
+    // Past the soft limit every collection is a major one
+    if (over_soft_limit()) {
+        request_collection();
+    }
+
     return ptr;
 }
 
+/**
+ * Write every object reachable from the roots to a heap snapshot, to be
+ * examined offline. See HeapSnapshot.h for the format.
+ * @param path The file to write
+ * @param stackPointer The stack pointer of the call point, or nullptr to skip the stack
+ * @param num_objects Set to the number of objects written
+ * @return False if the file could not be written
+ */
+bool GarbageCollector::write_heap_snapshot(const char* path, void* stackPointer, size_t* num_objects) {
+    assert(is_owner_thread());
+    CollectionScope scope(collection_lock_, collection_depth_);
+
+    std::vector<HeapSnapshotRoot> roots;
+
+    visit_stack_frames(stackPointer, [&roots](frame_info_t* frame_info, uintptr_t frame_base) {
+      for (uint16_t i = 0; i < frame_info->numSlots; i++) {
+          auto pointerSlot = frame_info->slots[i];
+          if (pointerSlot.kind < 0) {
+              roots.push_back({*reinterpret_cast<void**>(frame_base + pointerSlot.offset), kHeapRootStack});
+          }
+      }
+    });
+
+    for (auto root: object_roots_) {
+        roots.push_back({root, kHeapRootGlobal});
+    }
+
+    for (auto& it: pin_counts_) {
+        roots.push_back({it.first, kHeapRootPinned});
+    }
+
+    for (auto root = root_stack_base_; root < rt_gc_root_stack_top; root++) {
+        roots.push_back({*root, kHeapRootRootStack});
+    }
+
+    if (conservative_stack_ || stackPointer != nullptr) {
+        old_space_.finish_sweep();
+        scan_conservative_roots(stackPointer, true);
+
+        for (auto root: conservative_roots_) {
+            roots.push_back({root, kHeapRootConservative});
+        }
+    }
+
+    roots.push_back({current_exception, kHeapRootException});
+
+    return electrum::write_heap_snapshot(path, roots, num_objects);
+}
+
 /**
  * Explicitly free a garbage collected pointer
  * @param ptr The pointer of the memory block to free
@@ -239,6 +1534,7 @@ void GarbageCollector::free(void* ptr) {
 }
 
 void GarbageCollector::add_object_root(void* root) {
+    assert(is_owner_thread());
     if (!is_object(root)) {
         return;
     }
@@ -248,31 +1544,19 @@ void GarbageCollector::add_object_root(void* root) {
 }
 
 bool GarbageCollector::remove_object_root(void* root) {
+    assert(is_owner_thread());
     object_roots_.erase(root);
     return true;
 }
 
+/**
+ * Unmap the unmarked large objects, and schedule the old space pages to be
+ * swept lazily.
+ * @return The number of large objects freed
+ */
 uint64_t GarbageCollector::sweep_heap() {
-    uint64_t numCollected = 0;
-
-    auto it = heap_objects_.begin();
-    while (it != heap_objects_.end()) {
-        auto header = TAG_TO_OBJECT(*it);
-
-        if (!header->gc_mark) {
-            // Object is not marked, collect it.
-            it = heap_objects_.erase(it);
-            this->free(header);
-            ++numCollected;
-        }
-        else {
-            // Object was marked, unmark it
-            header->gc_mark = 0;
-            ++it;
-        }
-    }
-
-    return numCollected;
+    old_space_.begin_sweep();
+    return large_space_.sweep();
 }
 
 void GarbageCollector::set_current_exception(void *exception) {
@@ -296,6 +1580,12 @@ extern "C" void rt_gc_init_stackmap(void* stackmap) {
     }
 }
 
+extern "C" void rt_gc_remove_stackmap(void* stackmap) {
+    if (stackmap != nullptr) {
+        rt_get_gc()->remove_stackmap(stackmap);
+    }
+}
+
 extern "C" void rt_gc_add_root(void* obj) {
     auto collector = rt_get_gc();
     collector->add_object_root(obj);
@@ -306,13 +1596,212 @@ extern "C" void rt_gc_remove_root(void* obj) {
     collector->remove_object_root(obj);
 }
 
+extern "C" void rt_gc_push_root(void* obj) {
+    if (rt_gc_root_stack_top == rt_gc_root_stack_limit) {
+        rt_gc_root_stack_overflow();
+    }
+
+    *rt_gc_root_stack_top++ = obj;
+}
+
+extern "C" void rt_gc_pop_root() {
+    rt_gc_root_stack_top--;
+}
+
+/**
+ * Called when a root is pushed onto a full root stack
+ */
+extern "C" void rt_gc_root_stack_overflow() {
+    el_rt_throw(el_rt_allocate_exception(
+            "electrum.stack-overflow",
+            "GC root stack overflow",
+            NIL_PTR));
+}
+
+/**
+ * Keep an object alive and at the same address until rt_gc_unpin(). Pins
+ * nest. Native code needs this only for a raw pointer the collector can't
+ * see, such as one it keeps after returning, or in memory of its own.
+ * Pointers in its stack frame are found by the conservative scan of the
+ * frames that have no stack map, and are not moved.
+ */
+extern "C" void rt_gc_pin(void* obj) {
+    auto collector = rt_get_gc();
+    collector->pin(obj);
+}
+
+extern "C" void rt_gc_unpin(void* obj) {
+    auto collector = rt_get_gc();
+    collector->unpin(obj);
+}
+
+/**
+ * Copy the collector's statistics
+ */
+extern "C" void rt_gc_get_stats(electrum::GCStats* stats) {
+    *stats = rt_get_gc()->copy_stats();
+}
+
+/**
+ * Prepend a keyword and its value to a property list
+ */
+static void* plist_prepend(const char* key, void* value, void* plist) {
+    plist = rt_make_pair(value, plist);
+    return rt_make_pair(rt_make_keyword(key), plist);
+}
+
+static void* make_stat(uint64_t value) {
+    return rt_make_integer(static_cast<int64_t>(value));
+}
+
+/**
+ * The collector's statistics as a property list, for (gc-stats)
+ */
+extern "C" void* rt_gc_stats() {
+    // Copy them first, as building the list may collect
+    electrum::GCStats stats;
+    rt_gc_get_stats(&stats);
+
+    auto& last = stats.last_collection;
+
+    auto by_type = NIL_PTR;
+    for (auto tag = electrum::kMaxObjectTypes; tag > 0; tag--) {
+        auto name = electrum::object_layouts[tag - 1].name;
+        if (name != nullptr && last.live_bytes_by_type[tag - 1] != 0) {
+            by_type = plist_prepend(name, make_stat(last.live_bytes_by_type[tag - 1]), by_type);
+        }
+    }
+
+    auto collection = plist_prepend("live-bytes-by-type", by_type, NIL_PTR);
+    collection = plist_prepend("bytes-freed", make_stat(last.bytes_freed), collection);
+    collection = plist_prepend("objects-freed", make_stat(last.objects_freed), collection);
+    collection = plist_prepend("sweep-us", make_stat(last.sweep_us), collection);
+    collection = plist_prepend("mark-us", make_stat(last.mark_us), collection);
+    collection = plist_prepend("major", rt_make_boolean(last.major), collection);
+
+    auto result = plist_prepend("last-collection", collection, NIL_PTR);
+    result = plist_prepend("live-bytes", make_stat(stats.live_bytes), result);
+    result = plist_prepend("bytes-freed", make_stat(stats.bytes_freed), result);
+    result = plist_prepend("objects-freed", make_stat(stats.objects_freed), result);
+    result = plist_prepend("bytes-allocated", make_stat(stats.bytes_allocated), result);
+    result = plist_prepend("max-pause-us", make_stat(stats.max_pause_us), result);
+    result = plist_prepend("total-pause-us", make_stat(stats.total_pause_us), result);
+    result = plist_prepend("pauses", make_stat(stats.pauses), result);
+    result = plist_prepend("major-collections", make_stat(stats.major_collections), result);
+    return plist_prepend("minor-collections", make_stat(stats.minor_collections), result);
+}
+
+/**
+ * Name JIT'd code for the allocation profiler
+ */
+extern "C" void rt_gc_register_code(const char* name, uint64_t start, uint64_t size) {
+    rt_get_gc()->allocation_profiler().add_code(name, start, size);
+}
+
+extern "C" void rt_gc_remove_code(uint64_t start) {
+    rt_get_gc()->allocation_profiler().remove_code(start);
+}
+
+/**
+ * Ask for a collection at the next safepoint, for (gc-request-collection)
+ */
+extern "C" void* rt_gc_request_collection() {
+    rt_get_gc()->request_collection();
+    return NIL_PTR;
+}
+
+/**
+ * Start the allocation profiler, keeping any samples already taken
+ * @param interval Bytes allocated between samples, as an integer. Zero or less stops profiling.
+ */
+extern "C" void* rt_gc_start_allocation_profile(void* interval) {
+    auto bytes = rt_integer_value(interval);
+    rt_get_gc()->allocation_profiler().set_interval(bytes > 0 ? static_cast<size_t>(bytes) : 0);
+    return NIL_PTR;
+}
+
+extern "C" void* rt_gc_stop_allocation_profile() {
+    rt_get_gc()->allocation_profiler().set_interval(0);
+    return NIL_PTR;
+}
+
+/**
+ * The allocation profile, for (gc-allocation-profile). A list of property
+ * lists, one per call site and type, by estimated bytes allocated.
+ */
+extern "C" void* rt_gc_allocation_profile() {
+    // Copy the report first, as building the list may collect
+    auto report = rt_get_gc()->allocation_profiler().report();
+    auto result = NIL_PTR;
+
+    for (auto it = report.rbegin(); it != report.rend(); ++it) {
+        auto type_name = it->tag < electrum::kMaxObjectTypes ? electrum::object_layouts[it->tag].name : nullptr;
+
+        auto site = plist_prepend("bytes", make_stat(it->bytes), NIL_PTR);
+        site = plist_prepend("samples", make_stat(it->samples), site);
+        site = plist_prepend("type", rt_make_keyword(type_name != nullptr ? type_name : "unknown"), site);
+        site = plist_prepend("site", rt_make_string(it->site.c_str()), site);
+
+        result = rt_make_pair(site, result);
+    }
+
+    return result;
+}
+
+/**
+ * Write a heap snapshot from a statepoint. Throws electrum.io-error if the
+ * file cannot be written.
+ * @param path The path of the file, as a string
+ * @param stackPointer The stack pointer, as provided by rt_gc_heap_snapshot()
+ * @return The number of objects written
+ */
+extern "C" void* rt_gc_heap_snapshot_impl(void* path, void* stackPointer) {
+    auto   path_string = electrum::name_string(path);
+    size_t num_objects = 0;
+
+    if (!rt_get_gc()->write_heap_snapshot(path_string.c_str(), stackPointer, &num_objects)) {
+        el_rt_throw(el_rt_allocate_exception(
+                "electrum.io-error",
+                ("Cannot write heap snapshot to '" + path_string + "'").c_str(),
+                NIL_PTR));
+    }
+
+    return rt_make_integer(static_cast<int64_t>(num_objects));
+}
+
+/**
+ * A shim passing the stack pointer to rt_gc_heap_snapshot_impl, so the
+ * snapshot includes the stack slots of the JIT'd frames that called it
+ */
+extern "C" __attribute__((naked)) void* rt_gc_heap_snapshot(void* /* path */) {
+#if __x86_64__
+#if __APPLE__
+    asm("mov %rsp, %rsi\n"
+        "jmp _rt_gc_heap_snapshot_impl");
+#else
+    asm("mov %rsp, %rsi\n"
+        "jmp rt_gc_heap_snapshot_impl");
+#endif
+#elif __aarch64__
+#if __APPLE__
+    asm("mov x1, sp\n"
+        "b _rt_gc_heap_snapshot_impl");
+#else
+    asm("mov x1, sp\n"
+        "b rt_gc_heap_snapshot_impl");
+#endif
+#else
+#error Unsupported archetecture for GC
+#endif
+}
+
 /**
  * Entry into the garbage collector from a statepoint
  * @param stackPointer The stack pointer, as provided by rt_enter_gc()
  */
 extern "C" void rt_enter_gc_impl(void* stackPointer) {
     auto collector = rt_get_gc();
-    collector->collect(stackPointer);
+    collector->poll(stackPointer);
 }
 
 /**
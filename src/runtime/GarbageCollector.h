@@ -29,9 +29,49 @@
 
 #include <memory>
 #include "stackmap/api.h"
+#include "Nursery.h"
+#include "PageAllocator.h"
+#include "LargeObjectSpace.h"
+#include "StackMapIndex.h"
+#include "ParallelMarker.h"
+#include "HeapSnapshot.h"
+#include "AllocationProfiler.h"
+#include "InternTable.h"
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
 #include <list>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <chrono>
+
+struct EObjectHeader;
+
+/**
+ * Bytes that may still be allocated before the next collection. Nursery
+ * allocation is charged a whole allocation buffer at a time.
+ */
+extern "C" int64_t rt_gc_allocation_budget;
+
+/**
+ * Set once a collection is wanted, such as when the allocation budget is
+ * spent. Compiled code polls this flag inline and only calls into the
+ * collector when it is set.
+ */
+extern "C" uint8_t rt_gc_requested;
+
+/**
+ * The root stack holds values that compiled code must keep alive across
+ * calls. Pushing a root stores it at the top and bumps the pointer; a
+ * scope pops its roots by restoring the top it saved on entry.
+ *
+ * There is one root stack per process, so only the thread that owns the
+ * collector may run compiled code.
+ */
+extern "C" void** rt_gc_root_stack_top;
+extern "C" void** rt_gc_root_stack_limit;
 
 namespace electrum {
 
@@ -50,30 +90,370 @@ enum GCMode {
           kGCModeCompilerOwned
 };
 
+/**
+ * Flags kept in EObjectHeader::gc_mark. The upper bits hold the number of
+ * minor collections the object has survived. Mark bits are not kept in the
+ * header, but in side bitmaps owned by each space.
+ */
+enum GCHeaderBits : uint32_t {
+  kGCForwardedBit  = 1U << 1,
+  kGCRememberedBit = 1U << 2,
+  kGCPinnedBit     = 1U << 3
+};
+
+static const uint32_t kGCAgeShift = 8;
+static const uint32_t kGCAgeMask  = 0xFFU << kGCAgeShift;
+
+/** @return The number of marking threads to use when none is configured */
+inline size_t default_marker_threads() {
+    auto hardware_threads = static_cast<size_t>(std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min<size_t>(hardware_threads, 4));
+}
+
+/**
+ * Tuning parameters for the collector
+ */
+struct GCConfig {
+  /** Size in bytes of the young generation */
+  size_t nursery_size = 4 * 1024 * 1024;
+
+  /** Number of minor collections an object must survive before it is promoted */
+  uint32_t tenure_age = 2;
+
+  /** Minimum old generation size, in bytes, before a major collection is considered */
+  size_t major_collection_threshold = 16 * 1024 * 1024;
+
+  /** Number of threads used to mark the heap during a major collection */
+  size_t marker_threads = default_marker_threads();
+
+  /** Sweep the old generation on a background thread after marking */
+  bool background_sweep = true;
+
+  /** Spread the marking of major collections over many safepoints */
+  bool incremental_marking = false;
+
+  /** Target for the longest pause of an incremental collection, in microseconds */
+  uint64_t max_pause_us = 1000;
+
+  /** Bytes allocated between collections. Larger than the nursery, the excess is allocated old. */
+  size_t allocation_budget = 4 * 1024 * 1024;
+
+  /** Old generation growth allowed before the next major collection, for a small live set */
+  double max_heap_growth = 3.0;
+
+  /** Old generation growth allowed before the next major collection, for a large live set */
+  double min_heap_growth = 1.5;
+
+  /** Live set size, in bytes, at which the heap growth reaches min_heap_growth */
+  size_t heap_growth_live_size = 256 * 1024 * 1024;
+
+  /** Old space pages filled less than this by live objects are compacted at the end of a major collection, incremental or not. Zero disables compaction. */
+  double evacuation_threshold = 0.5;
+
+  /** Heap size in bytes past which every collection is a major one. Zero means no limit. */
+  size_t soft_heap_limit = 0;
+
+  /** Heap size in bytes past which allocation throws electrum.out-of-memory. Zero means no limit. */
+  size_t hard_heap_limit = 0;
+
+  /**
+   * With kGCModeInterpreterOwned, find roots by scanning the C stack
+   * conservatively, and collect at any allocation once one is due.
+   */
+  bool conservative_stack_scan = false;
+
+  /** Take an allocation sample every this many bytes allocated. Zero disables the allocation profiler. */
+  size_t allocation_sample_interval = 0;
+};
+
+/** Number of type tags that can have a layout, and so be allocated on the heap */
+static const size_t kMaxObjectTypes = 32;
+
+/**
+ * What one collection did. Old space pages are swept lazily or on a
+ * background thread, so the sweep time only covers the work done in the
+ * pause.
+ */
+struct GCCollectionStats {
+  /** True for a major collection, which traces the whole heap */
+  bool major = false;
+
+  /** Microseconds spent finding live objects: evacuating the nursery, then marking */
+  uint64_t mark_us = 0;
+
+  /** Microseconds spent freeing and compacting dead space */
+  uint64_t sweep_us = 0;
+
+  uint64_t objects_freed = 0;
+  uint64_t bytes_freed   = 0;
+
+  /** Bytes of live old objects of each type tag. Only set by a major collection. */
+  uint64_t live_bytes_by_type[kMaxObjectTypes] = {};
+};
+
+/**
+ * Totals since the collector was created
+ */
+struct GCStats {
+  uint64_t minor_collections = 0;
+  uint64_t major_collections = 0;
+
+  /** Safepoints that collected, or ran a slice of an incremental mark */
+  uint64_t pauses         = 0;
+  uint64_t total_pause_us = 0;
+  uint64_t max_pause_us   = 0;
+
+  /** Bytes allocated by the mutator. Nursery allocations are counted when a collection starts. */
+  uint64_t bytes_allocated = 0;
+
+  uint64_t objects_freed = 0;
+  uint64_t bytes_freed   = 0;
+
+  /** Live old bytes found by the last major collection */
+  uint64_t live_bytes = 0;
+
+  GCCollectionStats last_collection;
+};
+
+/** Maximum number of entries in the root stack */
+static const size_t kRootStackCapacity = 1024 * 1024;
+
+/** Objects scanned between deadline checks in an incremental mark slice */
+static const size_t kMarkSliceCheckInterval = 64;
+
+/** Mark slices run per allocation budget while an incremental mark is in progress */
+static const size_t kMarkSlicesPerBudget = 4;
+
 class GarbageCollector {
 public:
-    explicit GarbageCollector(GCMode mode);
+    explicit GarbageCollector(GCMode mode, GCConfig config = GCConfig());
     ~GarbageCollector();
 
     void init_stackmap(void* stackmap);
-    frame_info_t* get_frame_info(uint64_t return_address);
+    bool remove_stackmap(void* stackmap);
+    frame_info_t* get_frame_info(uint64_t return_address) { return stack_maps_.lookup(return_address); }
     void collect(void* stackPointer);
+    void poll(void* stackPointer);
+    void collect_minor(void* stackPointer);
+    void collect_major(void* stackPointer);
     void traverse_object(void* obj);
+
+    /** Roots and pins are not synchronised, so only the owning thread may change them */
     void add_object_root(void* root);
     bool remove_object_root(void* root);
+    void pin(void* obj);
+    void unpin(void* obj);
+
     void* malloc(size_t size);
     void* malloc_tagged_object(size_t size);
+    void* malloc_old(size_t size);
     void free(void* ptr);
     void set_current_exception(void* exception);
+    void* find_interned(uint32_t tag, const char* name, size_t length);
+    void* intern(void* value);
+
+    bool is_young(void* obj) const { return nursery_.contains(obj); }
+
+    bool is_marking() const { return marking_; }
+
+    size_t heap_size() const;
+
+    /** The collector's statistics. Only read them on the owning thread; other threads use copy_stats() */
+    const GCStats& stats() const { return stats_; }
+    GCStats copy_stats();
+
+    /** @return True if called on the thread that created the collector, the only one that collects */
+    bool is_owner_thread() const { return std::this_thread::get_id() == owner_thread_; }
+
+    AllocationProfiler& allocation_profiler() { return profiler_; }
+
+    bool write_heap_snapshot(const char* path, void* stackPointer, size_t* num_objects);
+
+    /** @return True once a collection has been requested at the next safepoint */
+    bool collection_requested() const { return __atomic_load_n(&rt_gc_requested, __ATOMIC_RELAXED) != 0; }
+
+    /** Ask for a collection at the next safepoint poll. May be called from any thread. */
+    void request_collection() { __atomic_store_n(&rt_gc_requested, 1, __ATOMIC_RELAXED); }
+
+    /**
+     * Record a store of value into a field of obj, replacing old_value.
+     * Must be called by every runtime function that mutates an existing
+     * heap object.
+     */
+    inline void write_barrier(void* obj, void* old_value, void* value) {
+        if (marking_) {
+            shade(old_value);
+        }
+
+        if (nursery_.contains(value) && !nursery_.contains(obj)) {
+            remember(obj);
+        }
+    }
 
 private:
-    std::vector<statepoint_table_t*> statepoint_tables_;
+    /** Call sites of every JIT'd module, by return address */
+    StackMapIndex stack_maps_;
+
     GCMode collector_mode_;
+    GCConfig config_;
     bool scan_stack_;
+
+    /** Scan the C stack for anything that looks like a pointer into the heap */
+    bool conservative_stack_;
+
+    /** Objects found by the last conservative stack scan */
+    std::vector<void*> conservative_roots_;
+
+    /** Only changed by the owning thread, like pin_counts_ */
     std::unordered_set<void*> object_roots_;
-    std::vector<void*> heap_objects_;
+
+    /** Objects pinned by native code, with their pin counts */
+    std::unordered_map<void*, uint32_t> pin_counts_;
+
+    void** root_stack_base_;
     uint64_t sweep_heap();
     void *current_exception;
+
+    Nursery nursery_;
+    PageAllocator old_space_;
+    LargeObjectSpace large_space_;
+
+    /** Serialises allocation in the old generation, which is shared by every thread */
+    std::mutex old_space_lock_;
+
+    /** The thread that created the collector. Collections only run on this thread. */
+    std::thread::id owner_thread_;
+
+    /**
+     * Held exclusively by the owning thread for the whole of a collection,
+     * and shared by other threads while they allocate, so they block until
+     * the collection is over. The stacks of other threads are not scanned,
+     * so anything they hold across a collection has to be stored in an
+     * object the owning thread has rooted.
+     */
+    std::shared_mutex collection_lock_;
+
+    /** Nesting depth of the collections running on the owning thread */
+    uint32_t collection_depth_;
+
+    /** Every symbol and keyword, by name */
+    InternTable interned_;
+
+    /** Old objects that may contain pointers into the nursery */
+    std::vector<void*> remembered_set_;
+
+    /** Serialises additions to the remembered set by write barriers on any thread */
+    std::mutex remembered_lock_;
+
+    /**
+     * Objects allocated old since the last collection, and their size,
+     * guarded by old_space_lock_. Their headers are written after
+     * allocation, so they join the remembered set when the next collection
+     * starts.
+     */
+    std::vector<void*> allocated_old_;
+    size_t allocated_old_bytes_;
+
+    /** Objects copied during a minor collection whose fields still need scanning */
+    std::vector<void*> grey_objects_;
+
+    /** Nursery objects that stayed in place during the current collection */
+    std::vector<void*> pinned_objects_;
+
+    /** Marked roots waiting to be scanned */
+    std::vector<EObjectHeader*> mark_roots_;
+
+    size_t old_space_bytes_;
+
+    /** Bytes of old objects found live by the current mark phase */
+    size_t marked_old_bytes_;
+
+    ParallelMarker marker_;
+    MarkVisitor mark_visitor_;
+
+    /** True while an incremental mark is in progress */
+    bool marking_;
+
+    /** Grey old objects of an incremental mark */
+    std::vector<EObjectHeader*> grey_stack_;
+    size_t next_major_threshold_;
+
+    GCStats stats_;
+
+    /** The major collection in progress, which may span many pauses */
+    GCCollectionStats major_stats_;
+
+    /** Objects and bytes in the nursery, as of the start of the current minor collection */
+    size_t young_objects_;
+    size_t young_bytes_;
+
+    /** Objects in the old generation, counted like old_space_bytes_ */
+    size_t old_objects_;
+
+    /** Young objects that survived the current minor collection, and those of them still young */
+    size_t survivor_objects_;
+    size_t survivor_bytes_;
+    size_t young_survivor_objects_;
+    size_t young_survivor_bytes_;
+
+    AllocationProfiler profiler_;
+
+    /** Set while the out of memory exception is being allocated */
+    bool allocating_out_of_memory_;
+
+    bool over_soft_limit() const;
+    void out_of_memory();
+
+    double heap_growth_factor(size_t live_bytes) const;
+    void reset_allocation_budget();
+
+    inline bool mark(const void* obj);
+    bool is_marked(const void* obj) const;
+    void add_mark_root(void* root);
+    void mark_roots(void* stackPointer);
+    void scan_conservative_roots(void* stackPointer, bool include_old);
+    void* find_object(void* ptr) const;
+    void compact(void* stackPointer);
+    void finish_major();
+    void start_incremental_mark(void* stackPointer);
+    void finish_incremental_mark(void* stackPointer);
+    bool mark_slice(std::chrono::steady_clock::time_point deadline);
+    void shade(void* obj);
+    void allocate_black(void* obj, size_t size);
+    void remember(void* obj);
+    void retire_old_allocations();
+    void* old_space_allocate(size_t size);
+    void* malloc_slow(AllocationBuffer& buffer, size_t size);
+    void* allocate_slow(AllocationBuffer& buffer, size_t size);
+    void* allocate_old(size_t size);
+    void charge_allocation(size_t size);
+    void* evacuate(void* obj, bool promote_all);
+    void scan_young_fields(void* obj, bool promote_all);
+    void evacuate_young(void* stackPointer, bool promote_all, GCCollectionStats& collection);
+    void count_survivor(void* obj, bool young);
+    void record_collection(const GCCollectionStats& collection);
+
+    template<typename F>
+    uintptr_t visit_stack_frames(void* stackPointer, F&& visitor);
+
+    template<typename F>
+    void visit_value_roots(F&& visitor);
+};
+
+/**
+ * Pops every root pushed onto the root stack during its lifetime,
+ * including when an exception unwinds through it.
+ */
+class RootStackScope {
+public:
+    RootStackScope() :saved_top_(rt_gc_root_stack_top) {}
+    ~RootStackScope() { rt_gc_root_stack_top = saved_top_; }
+
+    RootStackScope(const RootStackScope&) = delete;
+    RootStackScope& operator=(const RootStackScope&) = delete;
+
+private:
+    void** saved_top_;
 };
 
 static GarbageCollector* main_collector;
@@ -84,6 +464,10 @@ extern "C" {
 
 /* Exported functions */
 void rt_gc_init_stackmap(void* stackmap);
+void rt_gc_remove_stackmap(void* stackmap);
+void rt_gc_register_code(const char* name, uint64_t start, uint64_t size);
+void rt_gc_remove_code(uint64_t start);
+void* rt_gc_heap_snapshot(void* path);
 void rt_enter_gc_impl(void*);
 
 #ifdef __cplusplus
@@ -0,0 +1,200 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "HeapSnapshot.h"
+#include "ObjectLayout.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace electrum {
+
+/**
+ * Writes the parts of a snapshot file to a stdio stream
+ */
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(std::FILE* file) :file_(file) {}
+
+    void write_bytes(const void* data, size_t length) {
+        std::fwrite(data, 1, length, file_);
+    }
+
+    void write_uint32(uint32_t value) {
+        uint8_t bytes[4];
+        for (auto& byte: bytes) {
+            byte = static_cast<uint8_t>(value);
+            value >>= 8;
+        }
+        write_bytes(bytes, sizeof(bytes));
+    }
+
+    /** Write an unsigned LEB128 integer */
+    void write_uint(uint64_t value) {
+        do {
+            auto byte = static_cast<uint8_t>(value & 0x7F);
+            value >>= 7;
+            if (value != 0) {
+                byte |= 0x80;
+            }
+            std::fputc(byte, file_);
+        } while (value != 0);
+    }
+
+    void write_string(const char* str, size_t length) {
+        write_uint(length);
+        if (length != 0) {
+            write_bytes(str, length);
+        }
+    }
+
+private:
+    std::FILE* file_;
+};
+
+/**
+ * @param buffer Holds the label when it is not stored in the object
+ * @return The name of a symbol or keyword, the name of the immediate symbol
+ * bound by a var, or nullptr for other objects
+ */
+static const char* object_label(const EObjectHeader* obj, char* buffer, size_t* length) {
+    switch (obj->tag) {
+    case kETypeTagSymbol: {
+        auto sym = reinterpret_cast<const ESymbol*>(obj);
+        *length = std::min<size_t>(sym->length, kHeapSnapshotMaxLabel);
+        return sym->name;
+    }
+    case kETypeTagKeyword: {
+        auto keyword = reinterpret_cast<const EKeyword*>(obj);
+        *length = std::min<size_t>(keyword->length, kHeapSnapshotMaxLabel);
+        return keyword->name;
+    }
+    case kETypeTagVar: {
+        // A var bound to a heap symbol is labelled through its edge to it
+        auto var = reinterpret_cast<const EVar*>(obj);
+        if (is_short_symbol(var->sym)) {
+            *length = short_name_value(var->sym, buffer);
+            return buffer;
+        }
+
+        *length = 0;
+        return nullptr;
+    }
+    default:*length = 0;
+        return nullptr;
+    }
+}
+
+bool write_heap_snapshot(const char* path, const std::vector<HeapSnapshotRoot>& roots, size_t* num_objects) {
+    std::unordered_map<EObjectHeader*, size_t> ids;
+    std::vector<EObjectHeader*>                objects;
+    std::vector<uint8_t>                       root_kinds;
+
+    auto discover = [&](void* value) -> size_t {
+      auto header = TAG_TO_OBJECT(value);
+      auto result = ids.emplace(header, objects.size());
+      if (result.second) {
+          objects.push_back(header);
+          root_kinds.push_back(0);
+      }
+      return result.first->second;
+    };
+
+    for (auto& root: roots) {
+        if (is_object(root.value)) {
+            root_kinds[discover(root.value)] |= root.kind;
+        }
+    }
+
+    // The object list doubles as the queue of a breadth first search
+    for (size_t i = 0; i < objects.size(); i++) {
+        visit_pointer_fields(objects[i], [&](void** field) {
+          if (is_object(*field)) {
+              discover(*field);
+          }
+        });
+    }
+
+    auto file = std::fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    SnapshotWriter writer(file);
+    writer.write_bytes(kHeapSnapshotMagic, sizeof(kHeapSnapshotMagic));
+    writer.write_uint32(kHeapSnapshotVersion);
+
+    size_t num_types = 0;
+    for (size_t tag = 0; tag < kMaxObjectTypes; tag++) {
+        if (object_layouts[tag].name != nullptr) {
+            num_types++;
+        }
+    }
+
+    writer.write_uint(num_types);
+    for (size_t tag = 0; tag < kMaxObjectTypes; tag++) {
+        auto name = object_layouts[tag].name;
+        if (name != nullptr) {
+            writer.write_uint(tag);
+            writer.write_string(name, std::strlen(name));
+        }
+    }
+
+    writer.write_uint(objects.size());
+
+    std::vector<size_t> edges;
+    for (size_t i = 0; i < objects.size(); i++) {
+        auto obj = objects[i];
+
+        char   label_buffer[kShortNameMaxLength + 1];
+        size_t label_length;
+        auto   label = object_label(obj, label_buffer, &label_length);
+
+        writer.write_uint(obj->tag);
+        writer.write_uint(object_size(obj));
+        writer.write_uint(root_kinds[i]);
+        writer.write_string(label, label_length);
+
+        edges.clear();
+        visit_pointer_fields(obj, [&](void** field) {
+          if (is_object(*field)) {
+              edges.push_back(ids[TAG_TO_OBJECT(*field)]);
+          }
+        });
+
+        writer.write_uint(edges.size());
+        for (auto edge: edges) {
+            writer.write_uint(edge);
+        }
+    }
+
+    auto failed = std::ferror(file) != 0;
+    failed |= std::fclose(file) != 0;
+
+    *num_objects = objects.size();
+    return !failed;
+}
+
+}
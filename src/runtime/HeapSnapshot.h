@@ -0,0 +1,94 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_HEAPSNAPSHOT_H
+#define ELECTRUM_HEAPSNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace electrum {
+
+/**
+ * A heap snapshot file starts with kHeapSnapshotMagic and a 32 bit
+ * little-endian version, followed by LEB128 encoded unsigned integers:
+ *
+ *   num_types
+ *   num_types x { tag, name_length, name bytes }
+ *   num_objects
+ *   num_objects x { tag, size, root_kinds, label_length, label bytes,
+ *                   num_edges, num_edges x target }
+ *
+ * Objects are numbered by their position in the file, and edges name
+ * their target by that number. root_kinds is a set of HeapRootKind bits,
+ * zero for an object only reachable through other objects. Symbols and
+ * keywords are labelled with their name; other objects have no label.
+ */
+static const char     kHeapSnapshotMagic[8] = {'E', 'L', 'H', 'E', 'A', 'P', 'S', 0};
+static const uint32_t kHeapSnapshotVersion  = 1;
+
+/** Labels longer than this are truncated */
+static const size_t kHeapSnapshotMaxLabel = 256;
+
+/** Where a root was found */
+enum HeapRootKind : uint8_t {
+  /** A stack slot of a JIT'd frame */
+          kHeapRootStack        = 1U << 0,
+
+  /** A root registered with GarbageCollector::add_object_root */
+          kHeapRootGlobal       = 1U << 1,
+
+  /** An object pinned by native code */
+          kHeapRootPinned       = 1U << 2,
+
+  /** An entry of the root stack */
+          kHeapRootRootStack    = 1U << 3,
+
+  /** A word of the C stack that looks like a pointer into the heap */
+          kHeapRootConservative = 1U << 4,
+
+  /** The exception in flight */
+          kHeapRootException    = 1U << 5
+};
+
+struct HeapSnapshotRoot {
+  /** A tagged value, which is ignored unless it is an object */
+  void*   value;
+  uint8_t kind;
+};
+
+/**
+ * Write every object reachable from the roots to a snapshot file. Objects
+ * are read, not marked, so this is safe between any two collections.
+ * @param path The file to write
+ * @param roots The roots of the heap. A value may appear more than once.
+ * @param num_objects Set to the number of objects written
+ * @return False if the file could not be written
+ */
+bool write_heap_snapshot(const char* path, const std::vector<HeapSnapshotRoot>& roots, size_t* num_objects);
+
+}
+
+#endif //ELECTRUM_HEAPSNAPSHOT_H
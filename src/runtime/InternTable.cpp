@@ -0,0 +1,147 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "InternTable.h"
+#include "Runtime.h"
+#include <cstring>
+
+namespace electrum {
+
+/** @return The FNV-1a hash of a name and its type */
+static uint64_t hash_name(uint32_t tag, const char* name, size_t length) {
+    uint64_t hash = 14695981039346656037ULL ^ tag;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<uint8_t>(name[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/** Symbols and keywords share a layout */
+static ESymbol* name_object(void* value) {
+    return reinterpret_cast<ESymbol*>(TAG_TO_OBJECT(value));
+}
+
+InternTable::Table::Table(size_t capacity)
+        :mask(capacity - 1),
+         used(0),
+         slots(new std::atomic<void*>[capacity]) {
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+InternTable::InternTable()
+        :size_(0) {
+    tables_.emplace_back(new Table(kInternTableInitialCapacity));
+    table_.store(tables_.back().get(), std::memory_order_release);
+}
+
+void* InternTable::find(uint32_t tag, const char* name, size_t length) const {
+    auto table = table_.load(std::memory_order_acquire);
+    auto hash  = hash_name(tag, name, length);
+
+    // At most half of the slots are used, so the probe always ends
+    for (auto i = hash & table->mask;; i = (i + 1) & table->mask) {
+        auto value = table->slots[i].load(std::memory_order_acquire);
+        if (value == nullptr) {
+            return nullptr;
+        }
+
+        if (value == tombstone()) {
+            continue;
+        }
+
+        auto obj = name_object(value);
+        if (obj->header.tag == tag && obj->length == length && memcmp(obj->name, name, length) == 0) {
+            return value;
+        }
+    }
+}
+
+void* InternTable::insert(void* value) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    auto obj      = name_object(value);
+    auto existing = find(obj->header.tag, obj->name, obj->length);
+    if (existing != nullptr) {
+        return existing;
+    }
+
+    if ((tables_.back()->used + 1) * 2 > tables_.back()->mask + 1) {
+        grow();
+    }
+
+    add(tables_.back().get(), value);
+    size_++;
+    return value;
+}
+
+/**
+ * Put a name that is not in the table into the first free slot of its probe sequence
+ */
+void InternTable::add(Table* table, void* value) {
+    auto obj  = name_object(value);
+    auto hash = hash_name(obj->header.tag, obj->name, obj->length);
+
+    for (auto i = hash & table->mask;; i = (i + 1) & table->mask) {
+        auto slot = table->slots[i].load(std::memory_order_relaxed);
+
+        if (slot == nullptr || slot == tombstone()) {
+            if (slot == nullptr) {
+                table->used++;
+            }
+
+            table->slots[i].store(value, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+/**
+ * Copy the live entries into a table with room for as many again, then
+ * publish it. Readers may still be probing the old table, which is kept
+ * until the next update().
+ */
+void InternTable::grow() {
+    auto old_table = tables_.back().get();
+    auto capacity  = kInternTableInitialCapacity;
+    while (capacity < size_ * 4) {
+        capacity *= 2;
+    }
+
+    std::unique_ptr<Table> table(new Table(capacity));
+    for (size_t i = 0; i <= old_table->mask; i++) {
+        auto value = old_table->slots[i].load(std::memory_order_relaxed);
+        if (value != nullptr && value != tombstone()) {
+            add(table.get(), value);
+        }
+    }
+
+    table_.store(table.get(), std::memory_order_release);
+    tables_.push_back(std::move(table));
+}
+
+}
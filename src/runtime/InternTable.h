@@ -0,0 +1,135 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_INTERNTABLE_H
+#define ELECTRUM_INTERNTABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace electrum {
+
+/** Initial number of slots in an InternTable. Must be a power of two. */
+static const size_t kInternTableInitialCapacity = 1024;
+
+/**
+ * The symbols and keywords of the heap, by name, so that there is only
+ * one of each and they can be compared by address.
+ *
+ * Lookups take no lock: the slots are atomic, and a table that has grown
+ * is only freed by update(), when no other thread can be looking. Inserts
+ * are serialised by a mutex.
+ *
+ * Entries are weak. The collector calls update() to drop the names that
+ * died and to follow the ones that moved.
+ */
+class InternTable {
+public:
+    InternTable();
+
+    InternTable(const InternTable&) = delete;
+    InternTable& operator=(const InternTable&) = delete;
+
+    /**
+     * @param tag kETypeTagSymbol or kETypeTagKeyword
+     * @return The tagged symbol or keyword with the name, or nullptr if there is none
+     */
+    void* find(uint32_t tag, const char* name, size_t length) const;
+
+    /**
+     * Intern a new symbol or keyword
+     * @param value The tagged object, which must not move until the next update()
+     * @return value, or an equal object interned by another thread since find() was called
+     */
+    void* insert(void* value);
+
+    /**
+     * Replace every entry with the result of visitor, or drop it if the
+     * result is nullptr. Mutators must be stopped.
+     */
+    template<typename F>
+    void update(F&& visitor);
+
+    /** @return The number of interned names */
+    size_t size() const { return size_; }
+
+private:
+    struct Table {
+      explicit Table(size_t capacity);
+
+      size_t mask;
+
+      /** Slots in use, including removed entries */
+      size_t used;
+
+      std::unique_ptr<std::atomic<void*>[]> slots;
+    };
+
+    /** The table lookups go to, which is always tables_.back() */
+    std::atomic<Table*> table_;
+
+    /** The current table, then those it replaced that readers may still be using */
+    std::vector<std::unique_ptr<Table>> tables_;
+
+    std::mutex lock_;
+    size_t     size_;
+
+    static void* tombstone() { return reinterpret_cast<void*>(~static_cast<uintptr_t>(0)); }
+
+    void add(Table* table, void* value);
+    void grow();
+};
+
+template<typename F>
+void InternTable::update(F&& visitor) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    // No reader is left in the tables that were replaced
+    tables_.erase(tables_.begin(), tables_.end() - 1);
+
+    auto table = tables_.back().get();
+    for (size_t i = 0; i <= table->mask; i++) {
+        auto value = table->slots[i].load(std::memory_order_relaxed);
+        if (value == nullptr || value == tombstone()) {
+            continue;
+        }
+
+        auto updated = visitor(value);
+        if (updated == nullptr) {
+            table->slots[i].store(tombstone(), std::memory_order_relaxed);
+            size_--;
+        }
+        else {
+            table->slots[i].store(updated, std::memory_order_relaxed);
+        }
+    }
+}
+
+}
+
+#endif //ELECTRUM_INTERNTABLE_H
@@ -0,0 +1,130 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "LargeObjectSpace.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+
+namespace electrum {
+
+static size_t round_to_os_pages(size_t size) {
+    static const auto os_page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (size + os_page_size - 1) & ~(os_page_size - 1);
+}
+
+LargeObjectSpace::LargeObjectSpace()
+        :mapped_bytes_(0) {
+}
+
+LargeObjectSpace::~LargeObjectSpace() {
+    for (auto page: pages_) {
+        munmap(page, mapping_size(page));
+    }
+}
+
+size_t LargeObjectSpace::mapping_size(const Page* page) {
+    return round_to_os_pages(static_cast<size_t>(page->end - reinterpret_cast<const uint8_t*>(page)));
+}
+
+void* LargeObjectSpace::allocate(size_t size) {
+    // The header must be aligned to kPageSize so the page of the object can
+    // be found by masking. Over-allocate, then hand the unaligned ends back.
+    auto length   = round_to_os_pages(kPageHeaderSize + size);
+    auto map_size = length + kPageSize;
+    auto region   = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    auto start       = reinterpret_cast<uintptr_t>(region);
+    auto aligned     = (start + kPageSize - 1) & ~(kPageSize - 1);
+    auto end         = start + map_size;
+    auto mapping_end = aligned + length;
+
+    if (aligned > start) {
+        munmap(region, aligned - start);
+    }
+    if (end > mapping_end) {
+        munmap(reinterpret_cast<void*>(mapping_end), end - mapping_end);
+    }
+
+    // Fresh anonymous mappings are zeroed, so the bitmaps start out clear
+    auto page = reinterpret_cast<Page*>(aligned);
+    page->size_class = kLargeObjectSizeClass;
+    page->cell_size  = static_cast<uint32_t>(size);
+    page->live_cells = 1;
+    page->evacuating = 0;
+    page->free_list  = nullptr;
+    page->bump       = first_cell(page) + size;
+    page->end        = page->bump;
+
+    pages_.insert(std::upper_bound(pages_.begin(), pages_.end(), page), page);
+    mapped_bytes_ += length;
+
+    return first_cell(page);
+}
+
+void* LargeObjectSpace::find_object(const void* ptr) const {
+    auto it = std::upper_bound(pages_.begin(), pages_.end(), ptr, [](const void* address, const Page* page) {
+      return address < static_cast<const void*>(page);
+    });
+    if (it == pages_.begin()) {
+        return nullptr;
+    }
+
+    auto page = *(it - 1);
+    auto cell = static_cast<const uint8_t*>(ptr);
+    if (cell < first_cell(page) || cell >= page->end) {
+        return nullptr;
+    }
+
+    return first_cell(page);
+}
+
+uint64_t LargeObjectSpace::sweep() {
+    uint64_t num_freed = 0;
+    size_t   num_kept  = 0;
+
+    for (auto page: pages_) {
+        if (PageAllocator::is_marked(first_cell(page))) {
+            for (size_t i = 0; i < kPageBitmapWords; i++) {
+                page->mark_bits[i] = 0;
+            }
+            pages_[num_kept++] = page;
+        }
+        else {
+            auto length = mapping_size(page);
+            munmap(page, length);
+            mapped_bytes_ -= length;
+            num_freed++;
+        }
+    }
+
+    pages_.resize(num_kept);
+    return num_freed;
+}
+
+}
@@ -0,0 +1,91 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_LARGEOBJECTSPACE_H
+#define ELECTRUM_LARGEOBJECTSPACE_H
+
+#include "PageAllocator.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace electrum {
+
+/**
+ * Old generation space for objects larger than kMaxSmallObjectSize. Each
+ * object gets a mapping of its own, with a page header in front of it so
+ * it can be marked like any other old object. Large objects are never
+ * copied, and their memory is returned to the OS as soon as a sweep finds
+ * them dead.
+ */
+class LargeObjectSpace {
+public:
+    LargeObjectSpace();
+    ~LargeObjectSpace();
+
+    LargeObjectSpace(const LargeObjectSpace&) = delete;
+    LargeObjectSpace& operator=(const LargeObjectSpace&) = delete;
+
+    /**
+     * Map a region for an object of size bytes
+     * @return The allocated memory
+     */
+    void* allocate(size_t size);
+
+    /**
+     * Unmap every object that was not marked, and clear the marks of the rest.
+     * @return The number of objects freed
+     */
+    uint64_t sweep();
+
+    /** Call visitor with every marked object */
+    template<typename F>
+    void for_each_marked(F&& visitor) {
+        for (auto page: pages_) {
+            PageAllocator::for_each_marked_cell(page, visitor);
+        }
+    }
+
+    /**
+     * Find the large object containing ptr, for conservative root scanning
+     * @return The start of the object, or nullptr
+     */
+    void* find_object(const void* ptr) const;
+
+    size_t object_count() const { return pages_.size(); }
+
+    /** @return The number of bytes mapped for large objects, including headers */
+    size_t mapped_bytes() const { return mapped_bytes_; }
+
+private:
+    /** The page header of every object, in address order */
+    std::vector<Page*> pages_;
+    size_t             mapped_bytes_;
+
+    static size_t mapping_size(const Page* page);
+};
+
+}
+
+#endif //ELECTRUM_LARGEOBJECTSPACE_H
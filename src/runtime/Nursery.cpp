@@ -0,0 +1,271 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "Nursery.h"
+#include <sys/mman.h>
+#include <cassert>
+#include <algorithm>
+#include <new>
+
+namespace electrum {
+
+Nursery::Nursery(size_t size, bool track_starts)
+        :track_starts_(track_starts),
+         next_eden_block_(0),
+         survivor_cursor_(nullptr),
+         survivor_limit_(nullptr) {
+    num_blocks_ = size / kNurseryBlockSize;
+    if (num_blocks_ < 2) {
+        num_blocks_ = 2;
+    }
+
+    size_ = num_blocks_ * kNurseryBlockSize;
+
+    // Keep some blocks back from eden so that a minor collection always
+    // has somewhere to copy survivors to.
+    reserve_blocks_ = num_blocks_ / 8;
+    if (reserve_blocks_ == 0) {
+        reserve_blocks_ = 1;
+    }
+
+    auto region = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    start_ = reinterpret_cast<uintptr_t>(region);
+
+    block_states_.resize(num_blocks_, kNurseryBlockFree);
+    block_pin_counts_.resize(num_blocks_, 0);
+    block_pinned_.resize(num_blocks_, false);
+    block_residents_.resize(num_blocks_);
+    mark_bits_.resize(size_ / kObjectAlignment / 64, 0);
+    if (track_starts_) {
+        start_bits_.resize(size_ / kObjectAlignment / 64, 0);
+    }
+
+    // Free blocks are taken from the back, so push in reverse to allocate in address order
+    free_blocks_.reserve(num_blocks_);
+    for (size_t i = num_blocks_; i > 0; i--) {
+        free_blocks_.push_back(i - 1);
+    }
+
+    open_eden();
+}
+
+Nursery::~Nursery() {
+    munmap(reinterpret_cast<void*>(start_), size_);
+}
+
+uint8_t* Nursery::block_address(size_t index) const {
+    return reinterpret_cast<uint8_t*>(start_ + index * kNurseryBlockSize);
+}
+
+uint8_t* Nursery::take_free_block() {
+    auto index = free_blocks_.back();
+    free_blocks_.pop_back();
+
+    assert(block_states_[index] == kNurseryBlockFree);
+    block_states_[index] = kNurseryBlockInUse;
+    return block_address(index);
+}
+
+void Nursery::release_block(size_t index) {
+    block_states_[index]     = kNurseryBlockFree;
+    block_pin_counts_[index] = 0;
+    block_residents_[index].clear();
+    clear_block_starts(index);
+    free_blocks_.push_back(index);
+}
+
+void Nursery::clear_block_starts(size_t index) {
+    if (track_starts_) {
+        auto words_per_block = kNurseryBlockSize / kObjectAlignment / 64;
+        auto first           = start_bits_.begin() + index * words_per_block;
+        std::fill(first, first + words_per_block, 0);
+    }
+}
+
+void* Nursery::object_start(const void* ptr) const {
+    auto offset = reinterpret_cast<uintptr_t>(ptr) - start_;
+    if (!track_starts_ || offset >= size_ || block_states_[offset / kNurseryBlockSize] == kNurseryBlockFree) {
+        return nullptr;
+    }
+
+    // Search back for the closest start bit, without leaving the block
+    auto granule    = offset / kObjectAlignment;
+    auto first_word = (offset / kNurseryBlockSize) * (kNurseryBlockSize / kObjectAlignment / 64);
+    auto word       = granule / 64;
+    auto bits       = start_bits_[word] & (~0ULL >> (63 - granule % 64));
+
+    while (bits == 0) {
+        if (word == first_word) {
+            return nullptr;
+        }
+        bits = start_bits_[--word];
+    }
+
+    auto start_granule = word * 64 + (63 - static_cast<size_t>(__builtin_clzll(bits)));
+    return reinterpret_cast<void*>(start_ + start_granule * kObjectAlignment);
+}
+
+bool Nursery::refill(AllocationBuffer& buffer) {
+    auto next = next_eden_block_.fetch_add(1, std::memory_order_acquire);
+    if (next >= eden_blocks_.size()) {
+        return false;
+    }
+
+    // The block is ours alone, and unreachable by other threads until we
+    // hand out an object from it
+    auto index = eden_blocks_[next];
+    assert(block_states_[index] == kNurseryBlockFree);
+    block_states_[index] = kNurseryBlockInUse;
+
+    buffer.cursor = block_address(index);
+    buffer.end    = buffer.cursor + kNurseryBlockSize;
+    buffer.limit  = buffer.end;
+    return true;
+}
+
+/**
+ * Publish the free blocks beyond the reserve as eden, taking back any
+ * published earlier that no buffer has claimed yet.
+ */
+void Nursery::open_eden() {
+    close_eden();
+
+    // Free blocks are taken from the back, so move them in that order to allocate in address order
+    while (free_blocks_.size() > reserve_blocks_) {
+        eden_blocks_.push_back(free_blocks_.back());
+        free_blocks_.pop_back();
+    }
+
+    next_eden_block_.store(0, std::memory_order_release);
+}
+
+/**
+ * Return the eden blocks no buffer has claimed to the free list
+ */
+void Nursery::close_eden() {
+    auto next = std::min(next_eden_block_.load(std::memory_order_relaxed), eden_blocks_.size());
+    for (auto i = eden_blocks_.size(); i > next; i--) {
+        free_blocks_.push_back(eden_blocks_[i - 1]);
+    }
+
+    eden_blocks_.clear();
+    next_eden_block_.store(0, std::memory_order_relaxed);
+}
+
+void Nursery::clear_marks() {
+    std::fill(mark_bits_.begin(), mark_bits_.end(), 0);
+}
+
+size_t Nursery::bytes_free() const {
+    auto next = std::min(next_eden_block_.load(std::memory_order_relaxed), eden_blocks_.size());
+    return (eden_blocks_.size() - next) * kNurseryBlockSize;
+}
+
+void Nursery::begin_collection() {
+    for (size_t i = 0; i < num_blocks_; i++) {
+        if (block_states_[i] == kNurseryBlockInUse) {
+            block_states_[i] = kNurseryBlockFromSpace;
+            block_pinned_[i] = false;
+            block_residents_[i].clear();
+        }
+    }
+
+    // Eden is closed until the collection has finished, so survivors may use every free block
+    close_eden();
+    survivor_cursor_ = nullptr;
+    survivor_limit_  = nullptr;
+}
+
+void* Nursery::allocate_survivor(size_t size) {
+    size = align_object_size(size);
+
+    if (size > static_cast<size_t>(survivor_limit_ - survivor_cursor_)) {
+        if (free_blocks_.empty()) {
+            return nullptr;
+        }
+
+        survivor_cursor_ = take_free_block();
+        survivor_limit_  = survivor_cursor_ + kNurseryBlockSize;
+    }
+
+    auto ptr = survivor_cursor_;
+    survivor_cursor_ += size;
+    if (track_starts_) {
+        set_start(ptr);
+    }
+    return ptr;
+}
+
+void Nursery::pin(void* obj) {
+    auto index = (reinterpret_cast<uintptr_t>(obj) - start_) / kNurseryBlockSize;
+    assert(block_states_[index] == kNurseryBlockFromSpace);
+
+    block_pinned_[index] = true;
+    block_residents_[index].push_back(obj);
+}
+
+std::vector<void*> Nursery::end_collection(uint32_t tenure_age) {
+    std::vector<void*> tenured;
+
+    for (size_t i = 0; i < num_blocks_; i++) {
+        if (block_states_[i] != kNurseryBlockFromSpace) {
+            continue;
+        }
+
+        if (!block_pinned_[i]) {
+            release_block(i);
+            continue;
+        }
+
+        // The block is retained, but nothing more will be allocated in it.
+        // Only its pinned objects are still alive.
+        if (track_starts_) {
+            clear_block_starts(i);
+            for (auto obj: block_residents_[i]) {
+                set_start(obj);
+            }
+        }
+
+        block_pin_counts_[i] += 1;
+        if (block_pin_counts_[i] >= tenure_age) {
+            block_states_[i] = kNurseryBlockTenured;
+            tenured.insert(tenured.end(), block_residents_[i].begin(), block_residents_[i].end());
+        }
+        else {
+            block_states_[i] = kNurseryBlockInUse;
+        }
+    }
+
+    survivor_cursor_ = nullptr;
+    survivor_limit_  = nullptr;
+
+    open_eden();
+    return tenured;
+}
+
+}
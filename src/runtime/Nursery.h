@@ -0,0 +1,314 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_NURSERY_H
+#define ELECTRUM_NURSERY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+
+namespace electrum {
+
+/** Size of a nursery block. Blocks are the unit of reuse and pinning. */
+static const size_t kNurseryBlockSize = 32 * 1024;
+
+/** All heap objects are 16 byte aligned, so that the low 4 bits are free for tags. */
+static const size_t kObjectAlignment = 16;
+
+inline size_t align_object_size(size_t size) {
+    return (size + (kObjectAlignment - 1)) & ~(kObjectAlignment - 1);
+}
+
+enum NurseryBlockState : uint8_t {
+  /** The block holds no live objects and can be handed out for allocation. */
+          kNurseryBlockFree,
+
+  /** The block was retained for pinned objects long enough to be promoted in place. */
+          kNurseryBlockTenured,
+
+  /** The block holds young objects. */
+          kNurseryBlockInUse,
+
+  /** The block is being evacuated by the current minor collection. */
+          kNurseryBlockFromSpace
+};
+
+/**
+ * A thread's private run of nursery memory. Only the owning thread bumps
+ * the cursor, so allocating from it needs no synchronisation.
+ */
+struct AllocationBuffer {
+  uint8_t* cursor = nullptr;
+
+  /** Where bump allocation stops. Lowered below end to stop at the next allocation sample. */
+  uint8_t* limit = nullptr;
+
+  /** The end of the block being allocated from */
+  uint8_t* end = nullptr;
+
+  /** The cursor when bytes_to_sample was last brought up to date */
+  uint8_t* sample_base = nullptr;
+
+  /** Bytes left to allocate before the next allocation sample */
+  int64_t bytes_to_sample = 0;
+
+  /** Allocated from the buffer since it was last retired */
+  size_t objects = 0;
+  size_t bytes   = 0;
+};
+
+/**
+ * The young generation. A contiguous region split into fixed size blocks.
+ * Each allocating thread takes whole blocks from the shared eden list into
+ * its own AllocationBuffer, and bump allocates within them.
+ *
+ * A minor collection evacuates every live object out of the blocks that were
+ * in use when it started. Objects that cannot be moved (because a root refers
+ * to them by value) pin their block, which is retained until the objects
+ * die or the block has been pinned for long enough to be tenured in place.
+ */
+class Nursery {
+public:
+    /**
+     * @param size Size of the nursery in bytes
+     * @param track_starts Record where every object starts, so that object_start
+     * can find the object containing an arbitrary address
+     */
+    explicit Nursery(size_t size, bool track_starts = false);
+    ~Nursery();
+
+    /**
+     * Allocate from the thread's buffer.
+     * @return The allocated memory, or nullptr if it does not fit in the buffer
+     */
+    inline void* allocate(AllocationBuffer& buffer, size_t size) {
+        size = align_object_size(size);
+
+        if (size > static_cast<size_t>(buffer.limit - buffer.cursor)) {
+            return nullptr;
+        }
+
+        auto ptr = buffer.cursor;
+        buffer.cursor += size;
+        buffer.objects++;
+        buffer.bytes += size;
+        if (track_starts_) {
+            // Blocks are whole words of the bitmap, and a block has one owner
+            set_start(ptr);
+        }
+        return ptr;
+    }
+
+    /**
+     * Point the buffer at a fresh eden block. Safe to call from several
+     * threads at once while no collection is running.
+     * @return False if eden is exhausted
+     */
+    bool refill(AllocationBuffer& buffer);
+
+    /**
+     * Find the object that may contain ptr. Only available when object
+     * starts are tracked, and only for blocks holding live objects.
+     * @return The start of the last object at or below ptr in its block, or nullptr
+     */
+    void* object_start(const void* ptr) const;
+
+    /** True if ptr points into a block holding young objects */
+    inline bool contains(const void* ptr) const {
+        auto offset = reinterpret_cast<uintptr_t>(ptr) - start_;
+        return offset < size_ && block_states_[offset / kNurseryBlockSize] >= kNurseryBlockInUse;
+    }
+
+    /** True if ptr points into a block that is being evacuated */
+    inline bool in_from_space(const void* ptr) const {
+        auto offset = reinterpret_cast<uintptr_t>(ptr) - start_;
+        return offset < size_ && block_states_[offset / kNurseryBlockSize] == kNurseryBlockFromSpace;
+    }
+
+    /** True if ptr points anywhere in the nursery's address range */
+    inline bool in_region(const void* ptr) const {
+        return reinterpret_cast<uintptr_t>(ptr) - start_ < size_;
+    }
+
+    /**
+     * Set the mark bit of an object during a major collection. Only pinned
+     * objects and objects in tenured blocks are ever marked.
+     * @return True if the object was not already marked
+     */
+    inline bool mark(const void* obj) {
+        auto granule = (reinterpret_cast<uintptr_t>(obj) - start_) / kObjectAlignment;
+        auto bit     = 1ULL << (granule % 64);
+        auto& word   = mark_bits_[granule / 64];
+
+        if (__atomic_load_n(&word, __ATOMIC_RELAXED) & bit) {
+            return false;
+        }
+
+        return (__atomic_fetch_or(&word, bit, __ATOMIC_RELAXED) & bit) == 0;
+    }
+
+    inline bool is_marked(const void* obj) const {
+        auto granule = (reinterpret_cast<uintptr_t>(obj) - start_) / kObjectAlignment;
+        return (mark_bits_[granule / 64] & (1ULL << (granule % 64))) != 0;
+    }
+
+    void clear_marks();
+
+    /** Call visitor with every marked object in the nursery */
+    template<typename F>
+    void for_each_marked(F&& visitor) {
+        for (size_t word = 0; word < mark_bits_.size(); word++) {
+            auto bits = mark_bits_[word];
+            while (bits != 0) {
+                auto bit = static_cast<size_t>(__builtin_ctzll(bits));
+                bits &= bits - 1;
+                visitor(reinterpret_cast<void*>(start_ + (word * 64 + bit) * kObjectAlignment));
+            }
+        }
+    }
+
+    /** True if ptr points into a block that has been tenured in place */
+    inline bool in_tenured_block(const void* ptr) const {
+        auto offset = reinterpret_cast<uintptr_t>(ptr) - start_;
+        return offset < size_ && block_states_[offset / kNurseryBlockSize] == kNurseryBlockTenured;
+    }
+
+    /** Flip every in use block to from-space, ready for evacuation */
+    void begin_collection();
+
+    /**
+     * Allocate space for a survivor copy during a minor collection. Unlike
+     * eden allocation this may use the blocks held in reserve.
+     * @return The allocated memory, or nullptr if no free blocks remain
+     */
+    void* allocate_survivor(size_t size);
+
+    /** Keep the from-space block containing obj alive, as obj cannot be moved */
+    void pin(void* obj);
+
+    /**
+     * Release every from-space block that holds no pinned objects.
+     * @param tenure_age The number of consecutive collections a block may be
+     * pinned for before it is tenured in place
+     * @return The objects living in blocks that were tenured by this collection
+     */
+    std::vector<void*> end_collection(uint32_t tenure_age);
+
+    /**
+     * Drop dead objects from tenured blocks, freeing blocks with no survivors.
+     * @param is_live Predicate returning whether an object survived the major collection
+     */
+    template<typename F>
+    void sweep_tenured_blocks(F&& is_live) {
+        bool released = false;
+
+        for (size_t i = 0; i < num_blocks_; i++) {
+            if (block_states_[i] != kNurseryBlockTenured) {
+                continue;
+            }
+
+            auto& residents = block_residents_[i];
+            auto  it        = residents.begin();
+            while (it != residents.end()) {
+                if (is_live(*it)) {
+                    ++it;
+                }
+                else {
+                    clear_start(*it);
+                    it = residents.erase(it);
+                }
+            }
+
+            if (residents.empty()) {
+                release_block(i);
+                released = true;
+            }
+        }
+
+        if (released) {
+            open_eden();
+        }
+    }
+
+    size_t size() const { return size_; }
+
+    /** Bytes of eden not yet handed out to an allocation buffer */
+    size_t bytes_free() const;
+
+private:
+    uintptr_t  start_;
+    size_t     size_;
+    size_t     num_blocks_;
+    size_t     reserve_blocks_;
+
+    std::vector<NurseryBlockState>  block_states_;
+    std::vector<uint32_t>           block_pin_counts_;
+    std::vector<bool>               block_pinned_;
+    std::vector<std::vector<void*>> block_residents_;
+    std::vector<size_t>             free_blocks_;
+
+    /** One bit per 16 bytes of the nursery */
+    std::vector<uint64_t> mark_bits_;
+
+    /** One bit per 16 bytes, set where an object starts. Empty unless starts are tracked. */
+    std::vector<uint64_t> start_bits_;
+    bool                  track_starts_;
+
+    /**
+     * Free blocks published for allocation buffers to take. The list only
+     * changes while no mutator is allocating; in between, refills claim
+     * entries by bumping next_eden_block_.
+     */
+    std::vector<size_t> eden_blocks_;
+    std::atomic<size_t> next_eden_block_;
+
+    /* Survivor allocation, only used during a collection */
+    uint8_t* survivor_cursor_;
+    uint8_t* survivor_limit_;
+
+    void open_eden();
+    void close_eden();
+    uint8_t* take_free_block();
+    void release_block(size_t index);
+    uint8_t* block_address(size_t index) const;
+    void clear_block_starts(size_t index);
+
+    inline void set_start(const void* ptr) {
+        auto granule = (reinterpret_cast<uintptr_t>(ptr) - start_) / kObjectAlignment;
+        start_bits_[granule / 64] |= 1ULL << (granule % 64);
+    }
+
+    inline void clear_start(const void* ptr) {
+        if (track_starts_) {
+            auto granule = (reinterpret_cast<uintptr_t>(ptr) - start_) / kObjectAlignment;
+            start_bits_[granule / 64] &= ~(1ULL << (granule % 64));
+        }
+    }
+};
+
+}
+
+#endif //ELECTRUM_NURSERY_H
@@ -0,0 +1,95 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "ObjectLayout.h"
+#include "Dwarf_eh.h"
+#include <cassert>
+
+namespace electrum {
+
+#define LAYOUT_OFFSET(type, field) static_cast<uint32_t>(offsetof(type, field))
+
+ObjectLayout object_layouts[kMaxObjectTypes] = {
+        /* kETypeTagFloat */
+        {"float", sizeof(EFloat), 0, {}, kLayoutTailNone, false, 0, 0, 0, 0},
+
+        /* kETypeTagString */
+        {"string", sizeof(EString), 0, {},
+         kLayoutTailCounted, false, LAYOUT_OFFSET(EString, stringValue),
+         LAYOUT_OFFSET(EString, length), 1, 1},
+
+        /* kETypeTagSymbol */
+        {"symbol", sizeof(ESymbol), 0, {},
+         kLayoutTailCounted, false, LAYOUT_OFFSET(ESymbol, name),
+         LAYOUT_OFFSET(ESymbol, length), 1, 1},
+
+        /* kETypeTagKeyword */
+        {"keyword", sizeof(EKeyword), 0, {},
+         kLayoutTailCounted, false, LAYOUT_OFFSET(EKeyword, name),
+         LAYOUT_OFFSET(EKeyword, length), 1, 1},
+
+        /* kETypeTagPair */
+        {"pair", sizeof(EPair), 2,
+         {LAYOUT_OFFSET(EPair, value), LAYOUT_OFFSET(EPair, next)},
+         kLayoutTailNone, false, 0, 0, 0, 0},
+
+        /* kETypeTagFunction */
+        {"function", sizeof(ECompiledFunction), 0, {},
+         kLayoutTailCounted, true, LAYOUT_OFFSET(ECompiledFunction, env),
+         LAYOUT_OFFSET(ECompiledFunction, env_size), sizeof(void*), 0},
+
+        /* kETypeTagInterpretedFunction */
+        {"interpreted-function", sizeof(EInterpretedFunction), 3,
+         {LAYOUT_OFFSET(EInterpretedFunction, argnames),
+          LAYOUT_OFFSET(EInterpretedFunction, body),
+          LAYOUT_OFFSET(EInterpretedFunction, env)},
+         kLayoutTailNone, false, 0, 0, 0, 0},
+
+        /* kETypeTagEnvironment */
+        {"environment", sizeof(EEnvironment), 2,
+         {LAYOUT_OFFSET(EEnvironment, parent), LAYOUT_OFFSET(EEnvironment, values)},
+         kLayoutTailNone, false, 0, 0, 0, 0},
+
+        /* kETypeTagVar */
+        {"var", sizeof(EVar), 2,
+         {LAYOUT_OFFSET(EVar, sym), LAYOUT_OFFSET(EVar, val)},
+         kLayoutTailNone, false, 0, 0, 0, 0},
+
+        /* kETypeTagException */
+        {"exception", sizeof(ElectrumException), 1,
+         {LAYOUT_OFFSET(ElectrumException, metadata)},
+         kLayoutTailCString, false, LAYOUT_OFFSET(ElectrumException, message), 0, 1, 1},
+};
+
+#undef LAYOUT_OFFSET
+
+void register_object_layout(uint32_t tag, const ObjectLayout& layout) {
+    assert(tag < kMaxObjectTypes && "Type tag out of range");
+    assert(layout.num_pointer_fields <= kMaxLayoutPointerFields && "Too many pointer fields");
+    assert(object_layouts[tag].name == nullptr && "Type tag already has a layout");
+
+    object_layouts[tag] = layout;
+}
+
+}
@@ -0,0 +1,146 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_OBJECTLAYOUT_H
+#define ELECTRUM_OBJECTLAYOUT_H
+
+#include "Runtime.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace electrum {
+
+/** Maximum number of fixed pointer fields in a layout */
+static const size_t kMaxLayoutPointerFields = 6;
+
+/**
+ * How the length of the variable sized tail of an object is found
+ */
+enum LayoutTailKind : uint8_t {
+  /** The object has no tail */
+  kLayoutTailNone,
+
+  /** The number of tail elements is stored in a uint64_t field of the object */
+  kLayoutTailCounted,
+
+  /** The tail is a NUL terminated string */
+  kLayoutTailCString
+};
+
+/**
+ * Describes the shape of a heap object, so that the collector can size
+ * and trace it without knowing its type.
+ */
+struct ObjectLayout {
+  /** Name of the type, for heap snapshots and diagnostics */
+  const char* name;
+
+  /** Size in bytes of the fixed part of the object, including its header */
+  uint32_t fixed_size;
+
+  uint32_t num_pointer_fields;
+
+  /** Offsets of the fixed fields that may hold a tagged pointer */
+  uint32_t pointer_offsets[kMaxLayoutPointerFields];
+
+  LayoutTailKind tail_kind;
+
+  /** True if every tail element may hold a tagged pointer */
+  bool tail_holds_pointers;
+
+  /** Offset of the first tail element */
+  uint32_t tail_offset;
+
+  /** Offset of the uint64_t element count of a kLayoutTailCounted tail */
+  uint32_t tail_count_offset;
+
+  /** Size in bytes of a tail element */
+  uint32_t tail_element_size;
+
+  /** Bytes after the counted elements, such as a terminating NUL */
+  uint32_t tail_padding;
+};
+
+/** Layouts indexed by type tag. A null name marks an unused entry. */
+extern ObjectLayout object_layouts[kMaxObjectTypes];
+
+/**
+ * Describe the objects of a new type. Must be called before any object
+ * with the tag is allocated.
+ */
+void register_object_layout(uint32_t tag, const ObjectLayout& layout);
+
+inline const ObjectLayout& layout_of(const EObjectHeader* obj) {
+    return object_layouts[obj->tag];
+}
+
+/** @return The number of elements in the tail of obj */
+inline size_t tail_length(const EObjectHeader* obj, const ObjectLayout& layout) {
+    auto base = reinterpret_cast<const uint8_t*>(obj);
+
+    switch (layout.tail_kind) {
+    case kLayoutTailCounted:return *reinterpret_cast<const uint64_t*>(base + layout.tail_count_offset);
+    case kLayoutTailCString:return strlen(reinterpret_cast<const char*>(base + layout.tail_offset));
+    default:return 0;
+    }
+}
+
+/**
+ * @return The size in bytes of a heap object, including its header
+ */
+inline size_t object_size(const EObjectHeader* obj) {
+    auto& layout = layout_of(obj);
+
+    if (layout.tail_kind == kLayoutTailNone) {
+        return layout.fixed_size;
+    }
+
+    return layout.fixed_size + tail_length(obj, layout) * layout.tail_element_size + layout.tail_padding;
+}
+
+/**
+ * Call visitor with the address of every field of obj that may hold a tagged pointer
+ */
+template<typename F>
+inline void visit_pointer_fields(EObjectHeader* obj, F&& visitor) {
+    auto& layout = layout_of(obj);
+    auto  base   = reinterpret_cast<uint8_t*>(obj);
+
+    for (uint32_t i = 0; i < layout.num_pointer_fields; i++) {
+        visitor(reinterpret_cast<void**>(base + layout.pointer_offsets[i]));
+    }
+
+    if (layout.tail_holds_pointers) {
+        auto tail  = reinterpret_cast<void**>(base + layout.tail_offset);
+        auto count = tail_length(obj, layout);
+        for (size_t i = 0; i < count; i++) {
+            visitor(&tail[i]);
+        }
+    }
+}
+
+}
+
+#endif //ELECTRUM_OBJECTLAYOUT_H
@@ -0,0 +1,471 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "PageAllocator.h"
+#include <sys/mman.h>
+#include <algorithm>
+#include <cassert>
+#include <new>
+
+namespace electrum {
+
+PageAllocator::PageAllocator(bool background_sweep)
+        :resident_free_pages_(0),
+         unswept_count_(0),
+         sweeping_(0),
+         freed_objects_(0),
+         shutdown_(false) {
+    // Classes are 16 bytes apart up to 256 bytes, then four classes for
+    // every doubling in size.
+    for (size_t size = 16; size <= 256; size += 16) {
+        size_classes_.push_back(size);
+    }
+
+    for (size_t base = 256; base < kMaxSmallObjectSize; base *= 2) {
+        for (size_t step = 1; step <= 4; step++) {
+            size_classes_.push_back(base + step * (base / 4));
+        }
+    }
+
+    size_class_index_.resize(kMaxSmallObjectSize / 16 + 1);
+    size_t size_class = 0;
+    for (size_t granules = 0; granules < size_class_index_.size(); granules++) {
+        while (size_classes_[size_class] < granules * 16) {
+            size_class++;
+        }
+        size_class_index_[granules] = static_cast<uint8_t>(size_class);
+    }
+
+    current_pages_.resize(size_classes_.size(), nullptr);
+    available_pages_.resize(size_classes_.size());
+    unswept_pages_.resize(size_classes_.size());
+
+    if (background_sweep) {
+        sweeper_ = std::thread(&PageAllocator::sweeper_main, this);
+    }
+}
+
+PageAllocator::~PageAllocator() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_ = true;
+    }
+    sweep_condition_.notify_all();
+
+    if (sweeper_.joinable()) {
+        sweeper_.join();
+    }
+
+    for (auto chunk: chunks_) {
+        munmap(chunk, kPageSize * kPagesPerChunk);
+    }
+}
+
+void* PageAllocator::allocate_slow(size_t size_class) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Page* page = nullptr;
+
+    // Reuse a swept page, or sweep pages of this class until one has room.
+    // Pages are claimed under the lock, so the sweeper never works on a page
+    // the allocator is using, and unswept cells are never handed out.
+    auto& available = available_pages_[size_class];
+    auto& unswept   = unswept_pages_[size_class];
+
+    while (page == nullptr) {
+        if (!available.empty()) {
+            page = available.back();
+            available.pop_back();
+            break;
+        }
+
+        if (unswept.empty()) {
+            break;
+        }
+
+        auto candidate = unswept.back();
+        unswept.pop_back();
+        unswept_count_--;
+        sweeping_++;
+
+        lock.unlock();
+        auto num_freed = sweep_page(candidate);
+        lock.lock();
+
+        freed_objects_ += num_freed;
+        publish_swept_page(candidate);
+        sweeping_--;
+        trim_free_pages();
+        idle_condition_.notify_all();
+    }
+
+    if (page == nullptr) {
+        page = new_page(size_class);
+    }
+
+    lock.unlock();
+
+    current_pages_[size_class] = page;
+
+    if (page->free_list != nullptr) {
+        auto cell = page->free_list;
+        page->free_list = cell->next;
+        set_live(page, cell);
+        return cell;
+    }
+
+    assert(page->bump < page->end);
+    auto cell = page->bump;
+    page->bump += page->cell_size;
+    set_live(page, cell);
+    return cell;
+}
+
+void PageAllocator::begin_sweep() {
+    // Anything left over from the previous cycle has to be swept with the
+    // marks it was left with.
+    finish_sweep();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (size_t i = 0; i < size_classes_.size(); i++) {
+            current_pages_[i] = nullptr;
+            available_pages_[i].clear();
+        }
+
+        for (auto page: pages_) {
+            unswept_pages_[page->size_class].push_back(page);
+        }
+        unswept_count_ = pages_.size();
+        pages_.clear();
+        freed_objects_ = 0;
+    }
+
+    sweep_condition_.notify_one();
+}
+
+uint64_t PageAllocator::finish_sweep() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Help the sweeper with whatever is left, then wait for the pages it
+    // is working on.
+    for (auto& unswept: unswept_pages_) {
+        while (!unswept.empty()) {
+            auto page = unswept.back();
+            unswept.pop_back();
+            unswept_count_--;
+            sweeping_++;
+
+            lock.unlock();
+            auto num_freed = sweep_page(page);
+            lock.lock();
+
+            freed_objects_ += num_freed;
+            publish_swept_page(page);
+            sweeping_--;
+        }
+    }
+
+    idle_condition_.wait(lock, [this] { return sweeping_ == 0; });
+    trim_free_pages();
+    return freed_objects_;
+}
+
+std::vector<Page*> PageAllocator::begin_evacuation(double max_occupancy, const std::function<bool(Page*)>& is_pinned) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Page*> candidates;
+
+    for (auto page: pages_) {
+        size_t marked_cells = 0;
+        for (size_t word = 0; word < kPageBitmapWords; word++) {
+            marked_cells += static_cast<size_t>(__builtin_popcountll(page->mark_bits[word]));
+        }
+
+        // Empty pages are released by the sweep without any copying
+        if (marked_cells == 0) {
+            continue;
+        }
+
+        auto capacity  = static_cast<size_t>(page->end - first_cell(page));
+        auto occupancy = static_cast<double>(marked_cells * page->cell_size) / capacity;
+        if (occupancy >= max_occupancy || is_pinned(page)) {
+            continue;
+        }
+
+        page->evacuating = 1;
+        candidates.push_back(page);
+    }
+
+    if (candidates.empty()) {
+        return candidates;
+    }
+
+    // Copies must land in pages that are staying
+    for (size_t i = 0; i < size_classes_.size(); i++) {
+        if (current_pages_[i] != nullptr && current_pages_[i]->evacuating) {
+            current_pages_[i] = nullptr;
+        }
+
+        auto& available = available_pages_[i];
+        available.erase(std::remove_if(available.begin(), available.end(), [](Page* page) {
+          return page->evacuating != 0;
+        }), available.end());
+    }
+
+    return candidates;
+}
+
+void PageAllocator::end_evacuation(const std::vector<Page*>& pages) {
+    for (auto page: pages) {
+        for (size_t word = 0; word < kPageBitmapWords; word++) {
+            page->mark_bits[word] = 0;
+        }
+        page->evacuating = 0;
+    }
+}
+
+size_t PageAllocator::page_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pages_.size() + unswept_count_ + sweeping_;
+}
+size_t PageAllocator::resident_free_page_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resident_free_pages_;
+}
+
+void* PageAllocator::find_cell(const void* ptr) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto chunk = std::upper_bound(chunks_.begin(), chunks_.end(), ptr);
+    if (chunk == chunks_.begin()) {
+        return nullptr;
+    }
+
+    auto chunk_start = reinterpret_cast<uintptr_t>(*(chunk - 1));
+    if (reinterpret_cast<uintptr_t>(ptr) - chunk_start >= kPageSize * kPagesPerChunk) {
+        return nullptr;
+    }
+
+    // Pages that were never used, or were given back to the OS, have a
+    // zeroed header
+    auto page = page_of(ptr);
+    auto cell = static_cast<const uint8_t*>(ptr);
+    if (page->cell_size == 0 || cell < first_cell(page) || cell >= page->bump) {
+        return nullptr;
+    }
+
+    auto index      = static_cast<size_t>(cell - first_cell(page)) / page->cell_size;
+    auto cell_start = first_cell(page) + index * page->cell_size;
+    auto granule    = granule_index(page, cell_start);
+    if ((page->live_bits[granule / 64] & (1ULL << (granule % 64))) == 0) {
+        return nullptr;
+    }
+
+    return cell_start;
+}
+
+/**
+ * Sweep pages in the background until the allocator or the collector
+ * takes the remaining ones.
+ */
+void PageAllocator::sweeper_main() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        sweep_condition_.wait(lock, [this] { return shutdown_ || unswept_count_ > 0; });
+
+        if (shutdown_) {
+            return;
+        }
+
+        Page* page = nullptr;
+        for (auto& unswept: unswept_pages_) {
+            if (!unswept.empty()) {
+                page = unswept.back();
+                unswept.pop_back();
+                break;
+            }
+        }
+
+        unswept_count_--;
+        sweeping_++;
+
+        lock.unlock();
+        auto num_freed = sweep_page(page);
+        lock.lock();
+
+        freed_objects_ += num_freed;
+        publish_swept_page(page);
+        sweeping_--;
+        trim_free_pages();
+        idle_condition_.notify_all();
+    }
+}
+
+/**
+ * Make a swept page available to the allocator, or return it to the pool
+ * if nothing in it survived. Called with the lock held.
+ */
+void PageAllocator::publish_swept_page(Page* page) {
+    if (page->live_cells == 0) {
+        release_page(page);
+        return;
+    }
+
+    pages_.push_back(page);
+    if (page->free_list != nullptr || page->bump < page->end) {
+        available_pages_[page->size_class].push_back(page);
+    }
+}
+
+/**
+ * Free the cells of a page that were not marked, a word of the bitmaps
+ * at a time. Only touches the page itself, so it runs without the lock.
+ * @return The number of objects freed
+ */
+uint64_t PageAllocator::sweep_page(Page* page) {
+    uint64_t num_freed = 0;
+    auto     base      = reinterpret_cast<uint8_t*>(page);
+
+    // Cells survive if they were marked
+    for (size_t word = 0; word < kPageBitmapWords; word++) {
+        auto dead = page->live_bits[word] & ~page->mark_bits[word];
+        auto num_dead = static_cast<uint32_t>(__builtin_popcountll(dead));
+
+        page->live_bits[word] &= page->mark_bits[word];
+        page->mark_bits[word] = 0;
+        page->live_cells -= num_dead;
+        num_freed += num_dead;
+    }
+
+    // Empty pages stay resident until the sweep finishes, when all but a
+    // few of them are given back to the OS
+    if (page->live_cells == 0) {
+        return num_freed;
+    }
+
+    // Rebuild the free list in address order
+    FreeCell* free_head = nullptr;
+    FreeCell** free_tail = &free_head;
+
+    for (auto cell = first_cell(page); cell < page->bump; cell += page->cell_size) {
+        auto granule = static_cast<size_t>(cell - base) / kGranuleSize;
+        if (page->live_bits[granule / 64] & (1ULL << (granule % 64))) {
+            continue;
+        }
+
+        auto free_cell = reinterpret_cast<FreeCell*>(cell);
+        *free_tail = free_cell;
+        free_tail = &free_cell->next;
+    }
+
+    *free_tail = nullptr;
+    page->free_list = free_head;
+
+    return num_freed;
+}
+
+Page* PageAllocator::new_page(size_t size_class) {
+    if (free_pages_.empty()) {
+        // Over-allocate so the chunk can be aligned to the page size, then
+        // hand the unaligned ends back.
+        auto map_size = kPageSize * (kPagesPerChunk + 1);
+        auto region   = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        auto start   = reinterpret_cast<uintptr_t>(region);
+        auto aligned = (start + kPageSize - 1) & ~(kPageSize - 1);
+        auto end     = start + map_size;
+        auto chunk_end = aligned + kPageSize * kPagesPerChunk;
+
+        if (aligned > start) {
+            munmap(region, aligned - start);
+        }
+        if (end > chunk_end) {
+            munmap(reinterpret_cast<void*>(chunk_end), end - chunk_end);
+        }
+
+        auto chunk = reinterpret_cast<void*>(aligned);
+        chunks_.insert(std::upper_bound(chunks_.begin(), chunks_.end(), chunk), chunk);
+
+        for (size_t i = kPagesPerChunk; i > 0; i--) {
+            free_pages_.push_back(reinterpret_cast<Page*>(aligned + (i - 1) * kPageSize));
+        }
+    }
+
+    auto page = free_pages_.back();
+    free_pages_.pop_back();
+
+    if (resident_free_pages_ > 0) {
+        resident_free_pages_--;
+    }
+
+    auto cell_size  = size_classes_[size_class];
+    auto num_cells  = (kPageSize - kPageHeaderSize) / cell_size;
+
+    page->size_class = static_cast<uint32_t>(size_class);
+    page->cell_size  = static_cast<uint32_t>(cell_size);
+    page->live_cells = 0;
+    page->evacuating = 0;
+    page->free_list  = nullptr;
+    page->bump       = first_cell(page);
+    page->end        = first_cell(page) + num_cells * cell_size;
+
+    for (size_t i = 0; i < kPageBitmapWords; i++) {
+        page->live_bits[i] = 0;
+        page->mark_bits[i] = 0;
+    }
+
+    pages_.push_back(page);
+    return page;
+}
+
+void PageAllocator::release_page(Page* page) {
+    free_pages_.push_back(page);
+    resident_free_pages_++;
+}
+
+/**
+ * Give the memory of the empty pages beyond kResidentFreePages back to the
+ * OS, once no pages are left to sweep. The most recently emptied pages
+ * are kept, as they are the first to be reused. Called with the lock held.
+ */
+void PageAllocator::trim_free_pages() {
+    if (unswept_count_ != 0 || sweeping_ != 0 || resident_free_pages_ <= kResidentFreePages) {
+        return;
+    }
+
+    auto first = free_pages_.end() - static_cast<ptrdiff_t>(resident_free_pages_);
+    auto last  = free_pages_.end() - static_cast<ptrdiff_t>(kResidentFreePages);
+    for (auto it = first; it != last; ++it) {
+        // This zeroes the header too, so find_cell skips the page
+        madvise(*it, kPageSize, MADV_DONTNEED);
+    }
+
+    resident_free_pages_ = kResidentFreePages;
+}
+
+}
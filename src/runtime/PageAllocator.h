@@ -0,0 +1,318 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_PAGEALLOCATOR_H
+#define ELECTRUM_PAGEALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace electrum {
+
+/** Size of a page. Pages are aligned to their size, so the page of a cell can be found by masking. */
+static const size_t kPageSize = 16 * 1024;
+
+/** Number of pages reserved from the OS at a time */
+static const size_t kPagesPerChunk = 64;
+
+/**
+ * Empty pages kept resident once a sweep finishes, so the allocator can
+ * reuse them without faulting. Any more are given back to the OS.
+ */
+static const size_t kResidentFreePages = 16;
+
+/** Objects larger than this are not allocated from pages */
+static const size_t kMaxSmallObjectSize = 2048;
+
+/** Cells are aligned to, and tracked at, a granularity of 16 bytes */
+static const size_t kGranuleSize = 16;
+static const size_t kPageBitmapWords = kPageSize / kGranuleSize / 64;
+
+/** Size class of a page holding a single large object */
+static const uint32_t kLargeObjectSizeClass = 0xFFFFFFFF;
+
+/** A dead cell, threaded onto its page's free list */
+struct FreeCell {
+  FreeCell* next;
+};
+
+/**
+ * Header stored at the start of every page. All cells in a page are the
+ * same size. Objects too large for a size class get a page of their own
+ * in the large object space, which may extend beyond kPageSize.
+ */
+struct Page {
+  uint32_t size_class;
+  uint32_t cell_size;
+  uint32_t live_cells;
+
+  /** Non-zero while the live cells of the page are being moved out */
+  uint32_t evacuating;
+
+  /** Dead cells, in address order */
+  FreeCell* free_list;
+
+  /** The first cell that has never been allocated */
+  uint8_t* bump;
+
+  /** The end of the last cell in the page */
+  uint8_t* end;
+
+  /** One bit per granule, set at the start of every allocated cell */
+  uint64_t live_bits[kPageBitmapWords];
+
+  /** One bit per granule, set at the start of every cell marked by the collector */
+  uint64_t mark_bits[kPageBitmapWords];
+};
+
+/** Offset of the first cell in a page, keeping cells 16 byte aligned */
+static const size_t kPageHeaderSize = (sizeof(Page) + 15) & ~static_cast<size_t>(15);
+
+/** @return The address of the first cell of a page */
+inline uint8_t* first_cell(Page* page) {
+    return reinterpret_cast<uint8_t*>(page) + kPageHeaderSize;
+}
+
+/**
+ * Allocator for old generation objects. Small objects are segregated by
+ * size class into pages, so that objects of the same size are allocated
+ * contiguously and dead objects can be freed back to their page without
+ * any per-object bookkeeping.
+ *
+ * After a mark phase pages are swept either by a background thread or,
+ * when the allocator needs a page before the sweeper reaches it, by the
+ * allocating thread. The fast allocation path only touches the current
+ * page of a size class; everything else is guarded by a lock.
+ */
+class PageAllocator {
+public:
+    /** @param background_sweep Sweep pages on a background thread after each mark phase */
+    explicit PageAllocator(bool background_sweep = false);
+    ~PageAllocator();
+
+    PageAllocator(const PageAllocator&) = delete;
+    PageAllocator& operator=(const PageAllocator&) = delete;
+
+    /**
+     * Allocate a cell large enough for size bytes.
+     * @param size The size of the object, which must not exceed kMaxSmallObjectSize
+     * @return The allocated cell
+     */
+    inline void* allocate(size_t size) {
+        auto size_class = size_class_index_[(size + 15) / 16];
+        auto page       = current_pages_[size_class];
+
+        if (page != nullptr) {
+            if (page->free_list != nullptr) {
+                auto cell = page->free_list;
+                page->free_list = cell->next;
+                set_live(page, cell);
+                return cell;
+            }
+
+            if (page->bump < page->end) {
+                auto cell = page->bump;
+                page->bump += page->cell_size;
+                set_live(page, cell);
+                return cell;
+            }
+        }
+
+        return allocate_slow(size_class);
+    }
+
+    /**
+     * Set the mark bit of a cell. Atomic, so marking threads may race on it.
+     * @return True if the cell was not already marked
+     */
+    static inline bool mark(const void* cell) {
+        auto page    = page_of(cell);
+        auto granule = granule_index(page, cell);
+        auto bit     = 1ULL << (granule % 64);
+        auto& word   = page->mark_bits[granule / 64];
+
+        if (__atomic_load_n(&word, __ATOMIC_RELAXED) & bit) {
+            return false;
+        }
+
+        return (__atomic_fetch_or(&word, bit, __ATOMIC_RELAXED) & bit) == 0;
+    }
+
+    static inline bool is_marked(const void* cell) {
+        auto page    = page_of(cell);
+        auto granule = granule_index(page, cell);
+        return (page->mark_bits[granule / 64] & (1ULL << (granule % 64))) != 0;
+    }
+
+    /** @return The page containing the cell at ptr */
+    static inline Page* page_of(const void* ptr) {
+        return reinterpret_cast<Page*>(reinterpret_cast<uintptr_t>(ptr) & ~(kPageSize - 1));
+    }
+
+    /** @return The size of the cell that would be used for an object of size bytes */
+    size_t cell_size(size_t size) const {
+        return size_classes_[size_class_index_[(size + 15) / 16]];
+    }
+
+    /**
+     * Start sweeping after a mark phase. Pages are swept by the background
+     * sweeper, or when the allocator next needs a page of their size class.
+     */
+    void begin_sweep();
+
+    /**
+     * Sweep every page that has not been swept yet, and wait for the
+     * background sweeper. Must be called before the next mark phase.
+     * @return The number of objects freed since begin_sweep
+     */
+    uint64_t finish_sweep();
+
+    /**
+     * Pick the pages to compact after a mark phase: pages whose marked
+     * cells fill less than max_occupancy of the page. No more cells are
+     * allocated from the chosen pages, and until end_evacuation their
+     * marked cells are not visited by for_each_marked.
+     * Must be called after finish_sweep and before begin_sweep.
+     * @param is_pinned Returns true for pages that hold objects which must not move
+     * @return The pages to evacuate
+     */
+    std::vector<Page*> begin_evacuation(double max_occupancy, const std::function<bool(Page*)>& is_pinned);
+
+    /**
+     * Clear the marks of evacuated pages, so that the next sweep returns
+     * them to the pool.
+     */
+    void end_evacuation(const std::vector<Page*>& pages);
+
+    /**
+     * Call visitor with every marked cell of a page.
+     */
+    template<typename F>
+    static void for_each_marked_cell(Page* page, F&& visitor) {
+        auto base = reinterpret_cast<uint8_t*>(page);
+
+        for (size_t word = 0; word < kPageBitmapWords; word++) {
+            auto bits = page->mark_bits[word];
+            while (bits != 0) {
+                auto bit = static_cast<size_t>(__builtin_ctzll(bits));
+                bits &= bits - 1;
+                visitor(base + (word * 64 + bit) * kGranuleSize);
+            }
+        }
+    }
+
+    /**
+     * Call visitor with every marked cell in the pages, except those in
+     * pages being evacuated. Must be called between a mark phase
+     * and the following begin_sweep.
+     */
+    template<typename F>
+    void for_each_marked(F&& visitor) {
+        for (auto page: pages_) {
+            if (!page->evacuating) {
+                for_each_marked_cell(page, visitor);
+            }
+        }
+    }
+
+    /** @return The number of pages holding objects, swept or not */
+    size_t page_count() const;
+
+    /** @return The number of empty pages that may still be resident */
+    size_t resident_free_page_count() const;
+
+    /**
+     * Find the allocated cell containing ptr, for conservative root
+     * scanning. Must not run while pages are being swept.
+     * @return The start of the cell, or nullptr if ptr is not inside one
+     */
+    void* find_cell(const void* ptr) const;
+
+private:
+    std::vector<size_t> size_classes_;
+
+    /** Maps a size in 16 byte granules to its size class */
+    std::vector<uint8_t> size_class_index_;
+
+    /** The page each size class is currently allocating from */
+    std::vector<Page*> current_pages_;
+
+    /** Pages of each size class that have free cells */
+    std::vector<std::vector<Page*>> available_pages_;
+
+    /** Swept pages holding objects */
+    std::vector<Page*> pages_;
+
+    /** Pages of each size class waiting to be swept */
+    std::vector<std::vector<Page*>> unswept_pages_;
+
+    /** Pages that are not in use */
+    std::vector<Page*> free_pages_;
+
+    /**
+     * The number of pages at the end of free_pages_ that were emptied by a
+     * sweep and may still be resident. The rest are untouched or released.
+     */
+    size_t resident_free_pages_;
+
+    /** Chunks reserved from the OS, in address order */
+    std::vector<void*> chunks_;
+
+    /* Shared with the sweeper thread */
+    mutable std::mutex      mutex_;
+    std::condition_variable sweep_condition_;
+    std::condition_variable idle_condition_;
+    size_t                  unswept_count_;
+    size_t                  sweeping_;
+    uint64_t                freed_objects_;
+    bool                    shutdown_;
+    std::thread             sweeper_;
+
+    void* allocate_slow(size_t size_class);
+    Page* new_page(size_t size_class);
+    void release_page(Page* page);
+    uint64_t sweep_page(Page* page);
+    void publish_swept_page(Page* page);
+    void trim_free_pages();
+    void sweeper_main();
+
+    static inline size_t granule_index(const Page* page, const void* cell) {
+        return (reinterpret_cast<uintptr_t>(cell) - reinterpret_cast<uintptr_t>(page)) / kGranuleSize;
+    }
+
+    static inline void set_live(Page* page, void* cell) {
+        auto granule = granule_index(page, cell);
+        page->live_bits[granule / 64] |= 1ULL << (granule % 64);
+        page->live_cells++;
+    }
+};
+
+}
+
+#endif //ELECTRUM_PAGEALLOCATOR_H
@@ -0,0 +1,202 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "ParallelMarker.h"
+
+namespace electrum {
+
+ParallelMarker::ParallelMarker(size_t num_threads)
+        :generation_(0),
+         running_(0),
+         shutdown_(false),
+         visitor_(nullptr),
+         idle_workers_(0) {
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+
+    for (size_t i = 0; i < num_threads; i++) {
+        workers_.emplace_back(new MarkWorker());
+    }
+
+    // The thread calling mark() acts as worker 0
+    for (size_t i = 1; i < num_threads; i++) {
+        threads_.emplace_back(&ParallelMarker::thread_main, this, i);
+    }
+}
+
+ParallelMarker::~ParallelMarker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_ = true;
+    }
+    start_condition_.notify_all();
+
+    for (auto& thread: threads_) {
+        thread.join();
+    }
+}
+
+size_t ParallelMarker::mark(const std::vector<EObjectHeader*>& roots, const MarkVisitor& visitor) {
+    for (auto& worker: workers_) {
+        worker->marked_bytes = 0;
+    }
+
+    // Deal the roots out so every thread starts with some work
+    for (size_t i = 0; i < roots.size(); i++) {
+        workers_[i % workers_.size()]->deque.push(roots[i]);
+    }
+
+    visitor_ = &visitor;
+    idle_workers_.store(0);
+
+    if (!threads_.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = threads_.size();
+            generation_++;
+        }
+        start_condition_.notify_all();
+    }
+
+    run_worker(0);
+
+    if (!threads_.empty()) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_condition_.wait(lock, [this] { return running_ == 0; });
+    }
+
+    visitor_ = nullptr;
+
+    size_t marked_bytes = 0;
+    for (auto& worker: workers_) {
+        marked_bytes += worker->marked_bytes;
+    }
+
+    return marked_bytes;
+}
+
+void ParallelMarker::thread_main(size_t index) {
+    uint64_t seen_generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_condition_.wait(lock, [&] { return shutdown_ || generation_ != seen_generation; });
+
+            if (shutdown_) {
+                return;
+            }
+
+            seen_generation = generation_;
+        }
+
+        run_worker(index);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_--;
+        }
+        done_condition_.notify_one();
+    }
+}
+
+bool ParallelMarker::steal(size_t index, EObjectHeader*& obj) {
+    auto count = workers_.size();
+
+    for (size_t i = 1; i < count; i++) {
+        auto& victim = workers_[(index + i) % count]->deque;
+        if (victim.steal(obj)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Mark until there is no work left anywhere. Grey objects pass through a
+ * small FIFO and are prefetched as they enter it, so their cache lines
+ * have arrived by the time they are scanned.
+ */
+void ParallelMarker::run_worker(size_t index) {
+    auto& worker  = *workers_[index];
+    auto& visitor = *visitor_;
+
+    EObjectHeader* prefetched[kMarkPrefetchDepth];
+    size_t head  = 0;
+    size_t count = 0;
+
+    while (true) {
+        EObjectHeader* obj;
+
+        while (count < kMarkPrefetchDepth && worker.deque.pop(obj)) {
+            __builtin_prefetch(obj);
+            prefetched[(head + count) % kMarkPrefetchDepth] = obj;
+            count++;
+        }
+
+        if (count > 0) {
+            obj = prefetched[head];
+            head = (head + 1) % kMarkPrefetchDepth;
+            count--;
+
+            visitor(obj, worker);
+            continue;
+        }
+
+        if (steal(index, obj)) {
+            __builtin_prefetch(obj);
+            visitor(obj, worker);
+            continue;
+        }
+
+        // Out of work. Wait until either every worker is idle, in which
+        // case marking is finished, or another worker has work to steal.
+        idle_workers_.fetch_add(1);
+
+        while (true) {
+            if (idle_workers_.load() == workers_.size()) {
+                return;
+            }
+
+            bool work_available = false;
+            for (auto& other: workers_) {
+                if (!other->deque.empty()) {
+                    work_available = true;
+                    break;
+                }
+            }
+
+            if (work_available) {
+                idle_workers_.fetch_sub(1);
+                break;
+            }
+
+            std::this_thread::yield();
+        }
+    }
+}
+
+}
@@ -0,0 +1,109 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_PARALLELMARKER_H
+#define ELECTRUM_PARALLELMARKER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "WorkStealingDeque.h"
+
+struct EObjectHeader;
+
+namespace electrum {
+
+/** Number of grey objects prefetched ahead of the one being scanned */
+static const size_t kMarkPrefetchDepth = 8;
+
+/**
+ * Per thread marking state
+ */
+struct MarkWorker {
+  /** Grey objects. Other workers steal from it when they run out of work. */
+  WorkStealingDeque<EObjectHeader*> deque;
+
+  /** Bytes of old objects scanned by this worker */
+  size_t marked_bytes = 0;
+};
+
+/**
+ * Scans a grey object, pushing the children it marks onto the worker's deque
+ */
+using MarkVisitor = std::function<void(EObjectHeader* obj, MarkWorker& worker)>;
+
+/**
+ * Drives the mark phase across a pool of threads. The threads are started
+ * once and sleep between collections. Each thread drains its own deque,
+ * then steals from the others, and the phase ends once every thread is
+ * idle with an empty deque.
+ *
+ * Marking an object must be an atomic test-and-set, so that every object
+ * is pushed by exactly one thread.
+ */
+class ParallelMarker {
+public:
+    /** @param num_threads Number of threads marking, including the caller */
+    explicit ParallelMarker(size_t num_threads);
+    ~ParallelMarker();
+
+    ParallelMarker(const ParallelMarker&) = delete;
+    ParallelMarker& operator=(const ParallelMarker&) = delete;
+
+    /**
+     * Mark everything reachable from roots.
+     * @param roots Objects that have already been marked
+     * @param visitor Called once for every marked object
+     * @return The total of MarkWorker::marked_bytes across all workers
+     */
+    size_t mark(const std::vector<EObjectHeader*>& roots, const MarkVisitor& visitor);
+
+    size_t num_threads() const { return workers_.size(); }
+
+private:
+    std::vector<std::unique_ptr<MarkWorker>> workers_;
+    std::vector<std::thread>                 threads_;
+
+    std::mutex              mutex_;
+    std::condition_variable start_condition_;
+    std::condition_variable done_condition_;
+    uint64_t                generation_;
+    size_t                  running_;
+    bool                    shutdown_;
+
+    const MarkVisitor* visitor_;
+    std::atomic<size_t> idle_workers_;
+
+    void thread_main(size_t index);
+    void run_worker(size_t index);
+    bool steal(size_t index, EObjectHeader*& obj);
+};
+
+}
+
+#endif //ELECTRUM_PARALLELMARKER_H
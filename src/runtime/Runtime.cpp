@@ -58,14 +58,41 @@ namespace electrum {
         return false;
     }
 
+    bool is_float(void *val) {
+        return is_float_immediate(val) || is_object_with_tag(val, kETypeTagFloat);
+    }
+
+    bool is_string(void *val) {
+        return is_short_string(val) || is_object_with_tag(val, kETypeTagString);
+    }
+
+    bool is_symbol(void *val) {
+        return is_short_symbol(val) || is_object_with_tag(val, kETypeTagSymbol);
+    }
+
+    bool is_keyword(void *val) {
+        return is_short_keyword(val) || is_object_with_tag(val, kETypeTagKeyword);
+    }
+
     bool symbol_equal(void *s1, void *s2) {
-        assert(is_object_with_tag(s1, kETypeTagSymbol));
-        assert(is_object_with_tag(s2, kETypeTagSymbol));
+        assert(is_symbol(s1));
+        assert(is_symbol(s2));
 
-        auto s1Val = static_cast<ESymbol *>(static_cast<void *>(TAG_TO_OBJECT(s1)));
-        auto s2Val = static_cast<ESymbol *>(static_cast<void *>(TAG_TO_OBJECT(s2)));
+        // Symbols are immediates or interned
+        return s1 == s2;
+    }
+
+    std::string name_string(void *val) {
+        if (is_short_string(val) || is_short_symbol(val) || is_short_keyword(val)) {
+            return short_name_string(val);
+        }
 
-        return (std::string(s1Val->name) == std::string(s2Val->name));
+        if (is_string(val)) {
+            return rt_string_value(val);
+        } else if (is_symbol(val)) {
+            return rt_symbol_extract_string(val);
+        }
+        return rt_keyword_extract_string(val);
     }
 
     void print_pair(void *expr) {
@@ -83,6 +110,29 @@ namespace electrum {
         printf(")");
     }
 
+    /** @return The UTF-8 encoding of a character */
+    std::string char_to_utf8(uint32_t c) {
+        std::string utf8;
+
+        if (c < 0x80) {
+            utf8 += static_cast<char>(c);
+        } else if (c < 0x800) {
+            utf8 += static_cast<char>(0xC0 | (c >> 6));
+            utf8 += static_cast<char>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            utf8 += static_cast<char>(0xE0 | (c >> 12));
+            utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            utf8 += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            utf8 += static_cast<char>(0xF0 | (c >> 18));
+            utf8 += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            utf8 += static_cast<char>(0x80 | (c & 0x3F));
+        }
+
+        return utf8;
+    }
+
     std::string kind_for_obj(void *obj) {
         if (is_integer(obj)) {
             return "INTEGER";
@@ -90,6 +140,16 @@ namespace electrum {
             return "NIL";
         } else if (is_boolean(obj)) {
             return "BOOLEAN";
+        } else if (is_float_immediate(obj)) {
+            return "FLOAT";
+        } else if (is_short_string(obj)) {
+            return "STRING";
+        } else if (is_short_symbol(obj)) {
+            return "SYMBOL";
+        } else if (is_short_keyword(obj)) {
+            return "KEYWORD";
+        } else if (is_char(obj)) {
+            return "CHAR";
         } else if (!is_object(obj)) {
             return "";
         }
@@ -125,6 +185,26 @@ namespace electrum {
 
         if (is_integer(obj)) {
             ss << TAG_TO_INTEGER(obj);
+        } else if (is_float_immediate(obj)) {
+            ss << immediate_to_float(obj) << "f";
+        } else if (is_short_string(obj)) {
+            ss << "\"" << short_name_string(obj) << "\"";
+        } else if (is_short_symbol(obj)) {
+            ss << short_name_string(obj);
+        } else if (is_short_keyword(obj)) {
+            ss << ":" << short_name_string(obj);
+        } else if (is_char(obj)) {
+            // Named like the reader names them
+            auto c = rt_char_value(obj);
+            if (c == ' ') {
+                ss << "#\\space";
+            } else if (c == '\n') {
+                ss << "#\\newline";
+            } else if (c == '\t') {
+                ss << "#\\tab";
+            } else {
+                ss << "#\\" << char_to_utf8(c);
+            }
         } else if (is_object(obj)) {
             auto header = TAG_TO_OBJECT(obj);
 
@@ -182,6 +262,16 @@ namespace electrum {
     void print_expr(void *expr) {
         if (is_integer(expr)) {
             printf("Int:\t%li", TAG_TO_INTEGER(expr));
+        } else if (is_float_immediate(expr)) {
+            printf("Float:\t%f", immediate_to_float(expr));
+        } else if (is_short_string(expr)) {
+            printf("String:\t%s", short_name_string(expr).c_str());
+        } else if (is_short_symbol(expr)) {
+            printf("Symbol:\t%s", short_name_string(expr).c_str());
+        } else if (is_short_keyword(expr)) {
+            printf("Keyword:\t%s", short_name_string(expr).c_str());
+        } else if (is_char(expr)) {
+            printf("Char:\t%s", char_to_utf8(rt_char_value(expr)).c_str());
         } else if (is_object(expr)) {
             auto header = TAG_TO_OBJECT(expr);
 
@@ -253,8 +343,8 @@ extern "C" void rt_assert_tag(void *obj, ETypeTag tag, const char *msg) {
 
 //extern "C" {
 
-void rt_init_gc(electrum::GCMode gc_mode) {
-    electrum::main_collector = new electrum::GarbageCollector(gc_mode);
+void rt_init_gc(electrum::GCMode gc_mode, electrum::GCConfig config) {
+    electrum::main_collector = new electrum::GarbageCollector(gc_mode, config);
 }
 
 void rt_deinit_gc() {
@@ -310,6 +400,11 @@ extern "C" int64_t rt_integer_value(void *val) {
 }
 
 extern "C" void *rt_make_float(double value) {
+    void *immediate;
+    if (electrum::float_to_immediate(value, &immediate)) {
+        return immediate;
+    }
+
     auto floatVal = static_cast<EFloat *>(GC_MALLOC(sizeof(EFloat)));
     floatVal->header.tag = kETypeTagFloat;
     floatVal->header.gc_mark = 0;
@@ -318,36 +413,85 @@ extern "C" void *rt_make_float(double value) {
 }
 
 extern "C" void *rt_is_float(void *val) {
-    return TO_TAGGED_BOOLEAN(electrum::is_object_with_tag(val, kETypeTagFloat));
+    return TO_TAGGED_BOOLEAN(electrum::is_float(val));
 }
 
 extern "C" double rt_float_value(void *val) {
+    if (electrum::is_float_immediate(val)) {
+        return electrum::immediate_to_float(val);
+    }
+
     rt_assert_tag(val, kETypeTagFloat, "Expected float");
     auto header = TAG_TO_OBJECT(val);
     auto f = static_cast<EFloat *>(static_cast<void *>(header));
     return f->floatValue;
 }
 
-extern "C" void *rt_make_symbol(const char *name) {
+/**
+ * Buffers the C API decodes immediate names into, in turn, so a caller can
+ * hold a few names at once
+ */
+static const size_t kShortNameScratchBuffers = 4;
+static thread_local char short_name_scratch[kShortNameScratchBuffers][electrum::kShortNameMaxLength + 1];
+static thread_local size_t short_name_scratch_next = 0;
+
+/**
+ * @return The bytes of an immediate string, symbol or keyword, in a
+ * scratch buffer of the calling thread. It stays valid until that thread
+ * has decoded kShortNameScratchBuffers more names.
+ */
+static const char *short_name_chars(void *val) {
+    auto chars = short_name_scratch[short_name_scratch_next];
+    short_name_scratch_next = (short_name_scratch_next + 1) % kShortNameScratchBuffers;
+
+    electrum::short_name_value(val, chars);
+    return chars;
+}
+
+/**
+ * Find or create the one symbol or keyword with a name. Short names are
+ * immediates. Interned names are allocated old, as the intern table does
+ * not follow minor collections.
+ */
+static void *intern_name(uint32_t tag, const char *name) {
     size_t len = strlen(name);
+    if (len <= electrum::kShortNameMaxLength) {
+        auto keyword_bit = tag == kETypeTagKeyword ? SHORT_KEYWORD_BIT : 0;
+        return electrum::make_short_name(SHORT_SYMBOL_TAG | keyword_bit, name, len);
+    }
 
-    // Allocate enough space for the string
-    auto *symbolVal = static_cast<ESymbol *>(GC_MALLOC(sizeof(ESymbol) + (sizeof(char) * len) + 1));
-    symbolVal->header.tag = kETypeTagSymbol;
+    auto collector = rt_get_gc();
+
+    auto existing = collector->find_interned(tag, name, len);
+    if (existing != nullptr) {
+        return existing;
+    }
+
+    // Symbols and keywords share a layout
+    auto *symbolVal = static_cast<ESymbol *>(collector->malloc_old(sizeof(ESymbol) + (sizeof(char) * len) + 1));
+    symbolVal->header.tag = tag;
     symbolVal->header.gc_mark = 0;
-    strcpy(symbolVal->name, name);
+    memcpy(symbolVal->name, name, len);
     symbolVal->length = (uint64_t) len;
 
     // Add null termination
     symbolVal->name[len] = 0;
-    return OBJECT_TO_TAG(symbolVal);
+    return collector->intern(OBJECT_TO_TAG(symbolVal));
+}
+
+extern "C" void *rt_make_symbol(const char *name) {
+    return intern_name(kETypeTagSymbol, name);
 }
 
 extern "C" void *rt_is_symbol(void *val) {
-    return TO_TAGGED_BOOLEAN(electrum::is_object_with_tag(val, kETypeTagSymbol));
+    return TO_TAGGED_BOOLEAN(electrum::is_symbol(val));
 }
 
 extern "C" const char *rt_symbol_extract_string(void *val) {
+    if (electrum::is_short_symbol(val)) {
+        return short_name_chars(val);
+    }
+
     rt_assert_tag(val, kETypeTagSymbol, "Expected symbol");
     auto sym = reinterpret_cast<ESymbol *>(TAG_TO_OBJECT(val));
     return sym->name;
@@ -355,6 +499,9 @@ extern "C" const char *rt_symbol_extract_string(void *val) {
 
 extern "C" void *rt_make_string(const char *str) {
     size_t len = strlen(str);
+    if (len <= electrum::kShortNameMaxLength) {
+        return electrum::make_short_name(SHORT_STRING_TAG, str, len);
+    }
 
     // Allocate enough space for the string
     auto *strVal = static_cast<EString *>(GC_MALLOC(sizeof(EString) + (sizeof(char) * len) + 1));
@@ -369,40 +516,72 @@ extern "C" void *rt_make_string(const char *str) {
 }
 
 extern "C" void *rt_is_string(void *val) {
-    return TO_TAGGED_BOOLEAN(electrum::is_object_with_tag(val, kETypeTagString));
+    return TO_TAGGED_BOOLEAN(electrum::is_string(val));
 }
 
 extern "C" const char *rt_string_value(void *val) {
+    if (electrum::is_short_string(val)) {
+        return short_name_chars(val);
+    }
+
     rt_assert_tag(val, kETypeTagString, "Expected string");
     auto str = reinterpret_cast<EString *>(TAG_TO_OBJECT(val));
     return str->stringValue;
 }
 
 extern "C" void *rt_make_keyword(const char *str) {
-    size_t len = strlen(str);
-
-    // Allocate enough space for the string
-    auto *keywordVal = static_cast<EKeyword *>(GC_MALLOC(sizeof(EKeyword) + (sizeof(char) * len) + 1));
-    keywordVal->header.tag = kETypeTagKeyword;
-    keywordVal->header.gc_mark = 0;
-    strcpy(keywordVal->name, str);
-    keywordVal->length = (uint64_t) len;
-
-    // Add null termination
-    keywordVal->name[len] = 0;
-    return OBJECT_TO_TAG(keywordVal);
+    return intern_name(kETypeTagKeyword, str);
 }
 
 extern "C" void *rt_is_keyword(void *val) {
-    return TO_TAGGED_BOOLEAN(electrum::is_object_with_tag(val, kETypeTagKeyword));
+    return TO_TAGGED_BOOLEAN(electrum::is_keyword(val));
 }
 
 extern "C" const char *rt_keyword_extract_string(void *val) {
+    if (electrum::is_short_keyword(val)) {
+        return short_name_chars(val);
+    }
+
     rt_assert_tag(val, kETypeTagKeyword, "Expected keyword");
     auto sym = reinterpret_cast<EKeyword *>(TAG_TO_OBJECT(val));
     return sym->name;
 }
 
+extern "C" void *rt_make_char(uint32_t value) {
+    return reinterpret_cast<void *>((static_cast<uintptr_t>(value) << 8) | CHAR_TAG);
+}
+
+extern "C" void *rt_is_char(void *val) {
+    return TO_TAGGED_BOOLEAN(electrum::is_char(val));
+}
+
+extern "C" uint32_t rt_char_value(void *val) {
+    if (!electrum::is_char(val)) {
+        el_rt_throw(el_rt_allocate_exception(
+                "electrum.type-error",
+                "Expected char",
+                NIL_PTR));
+    }
+
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(val) >> 8);
+}
+
+extern "C" void *rt_char_to_integer(void *val) {
+    return rt_make_integer(rt_char_value(val));
+}
+
+extern "C" void *rt_integer_to_char(void *val) {
+    auto value = rt_integer_value(val);
+    if (value < 0 || value > 0x10FFFF) {
+        el_rt_throw(el_rt_allocate_exception(
+                "electrum.type-error",
+                "Expected a Unicode code point",
+                NIL_PTR));
+    }
+
+    return rt_make_char(static_cast<uint32_t>(value));
+}
+
 extern "C" void *rt_make_var(void *sym) {
     auto var = static_cast<EVar *>(GC_MALLOC(sizeof(EVar)));
     var->header.gc_mark = 0;
@@ -420,6 +599,7 @@ extern "C" void *rt_is_var(void *v) {
 extern "C" void rt_set_var(void *v, void *val) {
     rt_assert_tag(v, kETypeTagVar, "Expected var");
     auto var = reinterpret_cast<EVar *>(TAG_TO_OBJECT(v));
+    rt_get_gc()->write_barrier(v, var->val, val);
     var->val = val;
 }
 
@@ -460,6 +640,7 @@ void *rt_set_car(void *pair, void *val) {
     rt_assert_tag(pair, kETypeTagPair, "Expected pair");
     auto header = TAG_TO_OBJECT(pair);
     auto pairVal = static_cast<EPair *>(static_cast<void *>(header));
+    rt_get_gc()->write_barrier(pair, pairVal->value, val);
     pairVal->value = val;
     return pair;
 }
@@ -468,6 +649,7 @@ void *rt_set_cdr(void *pair, void *next) {
     rt_assert_tag(pair, kETypeTagPair, "Expected pair");
     auto header = TAG_TO_OBJECT(pair);
     auto pairVal = static_cast<EPair *>(static_cast<void *>(header));
+    rt_get_gc()->write_barrier(pair, pairVal->next, next);
     pairVal->next = next;
     return pair;
 }
@@ -493,6 +675,11 @@ extern "C" void *rt_make_compiled_function(uint32_t arity, uint32_t has_rest_arg
     funcVal->has_rest_args = has_rest_args;
     funcVal->f_ptr = fp;
     funcVal->env_size = env_size;
+
+    for (uint64_t i = 0; i < env_size; i++) {
+        funcVal->env[i] = NIL_PTR;
+    }
+
     return OBJECT_TO_TAG(funcVal);
 }
 
@@ -512,6 +699,7 @@ extern "C" void *rt_compiled_function_get_ptr(void *func) {
 
 extern "C" void *rt_compiled_function_set_env(void *func, uint64_t index, void *value) {
     auto funcVal = static_cast<ECompiledFunction *>(static_cast<void *>(TAG_TO_OBJECT(func)));
+    rt_get_gc()->write_barrier(func, funcVal->env[index], value);
     funcVal->env[index] = value;
     return funcVal;
 }
@@ -645,7 +833,9 @@ void *rt_make_environment(void *parent) {
 void *rt_environment_add(void *env, void *binding, void *value) {
     auto envVal = static_cast<EEnvironment *>(static_cast<void *>(TAG_TO_OBJECT(env)));
     auto currentValues = envVal->values;
-    envVal->values = rt_make_pair(binding, rt_make_pair(value, currentValues));
+    auto values = rt_make_pair(binding, rt_make_pair(value, currentValues));
+    rt_get_gc()->write_barrier(env, currentValues, values);
+    envVal->values = values;
     return env;
 }
 
@@ -673,7 +863,7 @@ void *rt_environment_get(void *env, void *binding) {
 
     el_rt_throw(el_rt_allocate_exception(
             "undefined-var-error",
-            ("Cannot find variable '" + std::string(rt_symbol_extract_string(binding))).c_str(),
+            ("Cannot find variable '" + electrum::name_string(binding)).c_str(),
             NIL_PTR));
 
     return NIL_PTR;
@@ -700,8 +890,8 @@ extern "C" void *rt_add(void *x, void *y) {
         return reinterpret_cast<void *>(reinterpret_cast<intptr_t>(x) + reinterpret_cast<intptr_t>(y));
     }
 
-    bool fx = electrum::is_object_with_tag(x, kETypeTagFloat);
-    bool fy = electrum::is_object_with_tag(y, kETypeTagFloat);
+    bool fx = electrum::is_float(x);
+    bool fy = electrum::is_float(y);
 
     if (fx && fy) {
         // float + float
@@ -732,8 +922,8 @@ extern "C" void *rt_sub(void *x, void *y) {
         return reinterpret_cast<void *>(reinterpret_cast<intptr_t>(x) - reinterpret_cast<intptr_t>(y));
     }
 
-    bool fx = electrum::is_object_with_tag(x, kETypeTagFloat);
-    bool fy = electrum::is_object_with_tag(y, kETypeTagFloat);
+    bool fx = electrum::is_float(x);
+    bool fy = electrum::is_float(y);
 
     if (fx && fy) {
         // float - float
@@ -765,8 +955,8 @@ extern "C" void *rt_mul(void *x, void *y) {
         return INTEGER_TO_TAG(iix * iiy);
     }
 
-    bool fx = electrum::is_object_with_tag(x, kETypeTagFloat);
-    bool fy = electrum::is_object_with_tag(y, kETypeTagFloat);
+    bool fx = electrum::is_float(x);
+    bool fy = electrum::is_float(y);
 
     if (fx && fy) {
         // float * float
@@ -803,8 +993,8 @@ extern "C" void *rt_div(void *x, void *y) {
         return INTEGER_TO_TAG(iix / iiy);
     }
 
-    bool fx = electrum::is_object_with_tag(x, kETypeTagFloat);
-    bool fy = electrum::is_object_with_tag(y, kETypeTagFloat);
+    bool fx = electrum::is_float(x);
+    bool fy = electrum::is_float(y);
 
     if (fy && rt_float_value(y) == 0) {
         // Div by zero
@@ -839,10 +1029,15 @@ extern "C" void *rt_eq(void *x, void *y) {
         return TO_TAGGED_BOOLEAN(x == y);
     } else if (x == NIL_PTR && y == NIL_PTR) {
         return TRUE_PTR;
+    } else if (electrum::is_float(x) && electrum::is_float(y)) {
+        // Either may be boxed
+        return TO_TAGGED_BOOLEAN(rt_float_value(x) == rt_float_value(y));
     }
 
     if (!(electrum::is_object(x) && electrum::is_object(y))) {
-        return FALSE_PTR;
+        // Short strings, symbols and keywords are never boxed, and are
+        // equal as words like characters
+        return TO_TAGGED_BOOLEAN(x == y);
     }
 
     auto tagx = TAG_TO_OBJECT(x)->tag;
@@ -853,14 +1048,12 @@ extern "C" void *rt_eq(void *x, void *y) {
     }
 
     switch (tagx) {
-        case kETypeTagFloat:
-            return TO_TAGGED_BOOLEAN(rt_float_value(x) == rt_float_value(y));
         case kETypeTagString:
             return TO_TAGGED_BOOLEAN(strcmp(rt_string_value(x), rt_string_value(y)) == 0);
         case kETypeTagSymbol:
-            return TO_TAGGED_BOOLEAN(strcmp(rt_symbol_extract_string(x), rt_symbol_extract_string(y)) == 0);
         case kETypeTagKeyword:
-            return TO_TAGGED_BOOLEAN(strcmp(rt_keyword_extract_string(x), rt_keyword_extract_string(y)) == 0);
+            // Interned, so equal names are the same object
+            return TO_TAGGED_BOOLEAN(x == y);
         default: // TODO: Others
             return FALSE_PTR;
     }
@@ -928,14 +1121,26 @@ extern "C" void *rt_print(void *expr) {
     } else if(expr == NIL_PTR) {
         printf("nil");
         return NIL_PTR;
+    } else if(electrum::is_float(expr)) {
+        printf("%f", rt_float_value(expr));
+        return NIL_PTR;
+    } else if(electrum::is_short_string(expr)) {
+        printf("%s", electrum::short_name_string(expr).c_str());
+        return NIL_PTR;
+    } else if(electrum::is_short_symbol(expr)) {
+        printf("%s", electrum::short_name_string(expr).c_str());
+        return NIL_PTR;
+    } else if(electrum::is_short_keyword(expr)) {
+        printf(":%s", electrum::short_name_string(expr).c_str());
+        return NIL_PTR;
+    } else if(electrum::is_char(expr)) {
+        printf("%s", electrum::char_to_utf8(rt_char_value(expr)).c_str());
+        return NIL_PTR;
     }
 
     auto obj = TAG_TO_OBJECT(expr);
 
     switch (obj->tag) {
-        case kETypeTagFloat:
-            printf("%f", rt_float_value(expr));
-            break;
         case kETypeTagString:
             printf("%s", rt_string_value(expr));
             break;
@@ -27,6 +27,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #include "GarbageCollector.h"
 
 #define TAG_MASK    0xFU
@@ -37,6 +38,15 @@
 #define FALSE_TAG   0x3U
 #define NIL_TAG     0xFU
 
+/** Immediate floats use the low three bits, so take the 0x5 and 0xD tags */
+#define FLOAT_TAG      0x5U
+#define FLOAT_TAG_MASK 0x7U
+
+#define SHORT_STRING_TAG  0x7U
+#define SHORT_SYMBOL_TAG  0x9U
+#define CHAR_TAG          0xBU
+#define SHORT_KEYWORD_BIT 0x80U
+
 #define TAG_TO_OBJECT(x)    reinterpret_cast<EObjectHeader*>(reinterpret_cast<uintptr_t>(x) & ~((uintptr_t)TAG_MASK))
 #define OBJECT_TO_TAG(x)    reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(x) | OBJECT_TAG)
 #define TAG_TO_INTEGER(x)   (reinterpret_cast<intptr_t>(x) >> 1)
@@ -149,8 +159,127 @@ bool is_boolean(void* val);
 
 bool is_object_with_tag(void* val, uint64_t tag);
 
+bool is_float(void* val);
+
+/**
+ * Doubles are immediates when the top four bits of their exponent are 0111
+ * or 1000, which covers magnitudes from 2^-127 up to 2^129. The three bits
+ * below the top one then repeat its inverse, so they are dropped to make
+ * room for the tag. +0.0 is the immediate with an empty payload, which
+ * would otherwise be 2^-127. Every other double is boxed in an EFloat.
+ */
+static const uint64_t kImmediateFloatPayloadMask = (1ULL << 59) - 1;
+
+inline bool is_float_immediate(void* val) {
+    return (reinterpret_cast<uintptr_t>(val) & FLOAT_TAG_MASK) == FLOAT_TAG;
+}
+
+/**
+ * @param immediate Set to the tagged value if the double is representable
+ * @return False if the double has to be boxed
+ */
+inline bool float_to_immediate(double value, void** immediate) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    if (bits == 0) {
+        *immediate = reinterpret_cast<void*>(FLOAT_TAG);
+        return true;
+    }
+
+    // Accepts 0111 and 1000 only. 2^-127 would encode like +0.0.
+    if ((((bits >> 59) + 1) & 0xE) != 0x8 || bits == 0x3800000000000000ULL) {
+        return false;
+    }
+
+    // Keep the sign and the top exponent bit, then the low 59 bits
+    auto payload = ((bits >> 62) << 59) | (bits & kImmediateFloatPayloadMask);
+    *immediate = reinterpret_cast<void*>((payload << 3) | FLOAT_TAG);
+    return true;
+}
+
+inline double immediate_to_float(void* val) {
+    auto     payload = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(val)) >> 3;
+    uint64_t bits    = 0;
+
+    if (payload != 0) {
+        auto high = payload >> 59;
+        bits = (high << 62) | (((high & 1) ^ 1) * 0x7ULL << 59) | (payload & kImmediateFloatPayloadMask);
+    }
+
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * Strings, symbols and keywords of up to seven bytes are immediates. The
+ * length is in bits 4-6 and the bytes follow from bit 8, zero filled, so
+ * equal names are equal words. Keywords are symbols with bit 7 set.
+ */
+static const size_t kShortNameMaxLength = 7;
+
+inline bool is_short_string(void* val) {
+    return (reinterpret_cast<uintptr_t>(val) & TAG_MASK) == SHORT_STRING_TAG;
+}
+
+inline bool is_short_symbol(void* val) {
+    return (reinterpret_cast<uintptr_t>(val) & (TAG_MASK | SHORT_KEYWORD_BIT)) == SHORT_SYMBOL_TAG;
+}
+
+inline bool is_short_keyword(void* val) {
+    return (reinterpret_cast<uintptr_t>(val) & (TAG_MASK | SHORT_KEYWORD_BIT)) == (SHORT_SYMBOL_TAG | SHORT_KEYWORD_BIT);
+}
+
+inline bool is_char(void* val) {
+    return (reinterpret_cast<uintptr_t>(val) & TAG_MASK) == CHAR_TAG;
+}
+
+/**
+ * @param tag SHORT_STRING_TAG or SHORT_SYMBOL_TAG, with SHORT_KEYWORD_BIT for a keyword
+ * @param length At most kShortNameMaxLength
+ */
+inline void* make_short_name(uintptr_t tag, const char* name, size_t length) {
+    uint64_t chars = 0;
+    memcpy(&chars, name, length);
+    return reinterpret_cast<void*>((chars << 8) | (length << 4) | tag);
+}
+
+/**
+ * Copy out the bytes of an immediate name, followed by a null
+ * @param buffer At least kShortNameMaxLength + 1 bytes
+ * @return The length of the name
+ */
+inline size_t short_name_value(void* val, char* buffer) {
+    auto     bits  = reinterpret_cast<uintptr_t>(val);
+    uint64_t chars = bits >> 8;
+
+    // The top byte is always zero, so this also terminates the name
+    memcpy(buffer, &chars, sizeof(chars));
+    return (bits >> 4) & 0x7;
+}
+
+/** @return A copy of the bytes of an immediate name */
+inline std::string short_name_string(void* val) {
+    char buffer[kShortNameMaxLength + 1];
+    auto length = short_name_value(val, buffer);
+    return std::string(buffer, length);
+}
+
+bool is_string(void* val);
+
+bool is_symbol(void* val);
+
+bool is_keyword(void* val);
+
 bool symbol_equal(void* s1, void* s2);
 
+/**
+ * @return A copy of the name of a string, symbol or keyword, immediate or
+ * not. Use this rather than the C API inside the runtime.
+ */
+std::string name_string(void* val);
+
 void print_expr(void* expr);
 
 std::string kind_for_obj(void* obj);
@@ -162,7 +291,7 @@ std::string description_for_obj(void* obj);
 //extern "C" {
 
 void rt_init();
-void rt_init_gc(electrum::GCMode gc_mode);
+void rt_init_gc(electrum::GCMode gc_mode, electrum::GCConfig config = electrum::GCConfig());
 void rt_deinit_gc();
 
 electrum::GarbageCollector* rt_get_gc();
@@ -180,6 +309,11 @@ extern "C" void* rt_make_float(double value);
 extern "C" void* rt_is_float(void* val);
 extern "C" double rt_float_value(void* val);
 
+/*
+ * The names returned for immediate strings, symbols and keywords are
+ * decoded into a scratch buffer of the calling thread, valid until it has
+ * decoded four more. Copy them if they must live longer.
+ */
 extern "C" void* rt_make_symbol(const char* name);
 extern "C" void* rt_is_symbol(void* val);
 extern "C" const char* rt_symbol_extract_string(void* val);
@@ -192,6 +326,12 @@ extern "C" void* rt_make_string(const char* str);
 extern "C" void* rt_is_string(void* val);
 extern "C" const char* rt_string_value(void* val);
 
+extern "C" void* rt_make_char(uint32_t value);
+extern "C" void* rt_is_char(void* val);
+extern "C" uint32_t rt_char_value(void* val);
+extern "C" void* rt_char_to_integer(void* val);
+extern "C" void* rt_integer_to_char(void* val);
+
 extern "C" void* rt_make_var(void* sym);
 extern "C" void* rt_is_var(void* v);
 extern "C" void rt_set_var(void* v, void* val);
@@ -210,6 +350,17 @@ void* rt_environment_add(void* env, void* binding, void* value);
 void* rt_environment_get(void* env, void* binding);
 void* rt_gc_malloc_tagged_object(size_t size);
 extern "C" void rt_gc_add_root(void* obj);
+extern "C" void rt_gc_push_root(void* obj);
+extern "C" void rt_gc_pop_root();
+extern "C" void rt_gc_root_stack_overflow();
+extern "C" void rt_gc_pin(void* obj);
+extern "C" void rt_gc_unpin(void* obj);
+extern "C" void rt_gc_get_stats(electrum::GCStats* stats);
+extern "C" void* rt_gc_stats();
+extern "C" void* rt_gc_request_collection();
+extern "C" void* rt_gc_start_allocation_profile(void* interval);
+extern "C" void* rt_gc_stop_allocation_profile();
+extern "C" void* rt_gc_allocation_profile();
 
 extern "C" void el_rt_throw(void* exception);
 extern "C" void* el_rt_allocate_exception(const char* exc_type, const char* message, void* meta);
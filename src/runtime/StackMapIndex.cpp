@@ -0,0 +1,154 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "StackMapIndex.h"
+
+extern "C" {
+#include "stackmap/hash_table.h"
+}
+
+namespace electrum {
+
+/**
+ * Call visitor with every frame info of a statepoint table
+ */
+template<typename F>
+static void for_each_frame(statepoint_table_t* table, F&& visitor) {
+    for (uint64_t i = 0; i < table->size; i++) {
+        auto& bucket = table->buckets[i];
+        auto  frame  = bucket.entries;
+
+        for (uint16_t entry = 0; entry < bucket.numEntries; entry++) {
+            visitor(frame);
+            frame = next_frame(frame);
+        }
+    }
+}
+
+StackMapIndex::StackMapIndex()
+        :slots_(kStackMapIndexInitialCapacity, Slot{0, nullptr}),
+         mask_(kStackMapIndexInitialCapacity - 1),
+         count_(0) {
+}
+
+StackMapIndex::~StackMapIndex() {
+    for (auto& entry: tables_) {
+        destroy_table(entry.second);
+    }
+}
+
+void StackMapIndex::add(void* stackmap) {
+    if (tables_.find(stackmap) != tables_.end()) {
+        return;
+    }
+
+    auto table = generate_table(stackmap, 0.5);
+    tables_[stackmap] = table;
+
+    for_each_frame(table, [this](frame_info_t* frame) {
+      insert(frame);
+    });
+}
+
+bool StackMapIndex::remove(void* stackmap) {
+    auto it = tables_.find(stackmap);
+    if (it == tables_.end()) {
+        return false;
+    }
+
+    auto table = it->second;
+    for_each_frame(table, [this](frame_info_t* frame) {
+      erase(frame->retAddr);
+    });
+
+    tables_.erase(it);
+    destroy_table(table);
+    return true;
+}
+
+void StackMapIndex::insert(frame_info_t* frame) {
+    // Keep the table at most half full, so probe sequences stay short
+    if ((count_ + 1) * 2 > slots_.size()) {
+        grow();
+    }
+
+    for (auto i = home_slot(frame->retAddr);; i = (i + 1) & mask_) {
+        auto& slot = slots_[i];
+        if (slot.frame == nullptr) {
+            slot = Slot{frame->retAddr, frame};
+            count_++;
+            return;
+        }
+        if (slot.return_address == frame->retAddr) {
+            slot.frame = frame;
+            return;
+        }
+    }
+}
+
+/**
+ * Remove an entry, shifting later entries of its probe sequence back into
+ * the hole so that lookups never need tombstones.
+ */
+void StackMapIndex::erase(uint64_t return_address) {
+    auto hole = home_slot(return_address);
+    while (slots_[hole].return_address != return_address) {
+        if (slots_[hole].frame == nullptr) {
+            return;
+        }
+        hole = (hole + 1) & mask_;
+    }
+
+    if (slots_[hole].frame == nullptr) {
+        return;
+    }
+
+    for (auto i = (hole + 1) & mask_; slots_[i].frame != nullptr; i = (i + 1) & mask_) {
+        // An entry can fill the hole if the hole lies between its home
+        // slot and where it is now, cyclically.
+        auto home = home_slot(slots_[i].return_address);
+        if (((i - home) & mask_) >= ((i - hole) & mask_)) {
+            slots_[hole] = slots_[i];
+            hole = i;
+        }
+    }
+
+    slots_[hole] = Slot{0, nullptr};
+    count_--;
+}
+
+void StackMapIndex::grow() {
+    std::vector<Slot> old_slots(slots_.size() * 2, Slot{0, nullptr});
+    old_slots.swap(slots_);
+    mask_  = slots_.size() - 1;
+    count_ = 0;
+
+    for (auto& slot: old_slots) {
+        if (slot.frame != nullptr) {
+            insert(slot.frame);
+        }
+    }
+}
+
+}
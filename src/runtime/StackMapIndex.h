@@ -0,0 +1,118 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_STACKMAPINDEX_H
+#define ELECTRUM_STACKMAPINDEX_H
+
+#include "stackmap/api.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace electrum {
+
+/** Initial number of slots in a StackMapIndex. Must be a power of two. */
+static const size_t kStackMapIndexInitialCapacity = 256;
+
+/**
+ * Maps the return address of every statepoint in every loaded module to
+ * its frame info. The call sites of all modules share one open addressing
+ * table, so a lookup costs the same however many modules have been loaded.
+ *
+ * Each stackmap is parsed into a statepoint table that owns its frame
+ * infos. The index only points into those tables, and drops a module's
+ * entries when its stackmap is removed.
+ */
+class StackMapIndex {
+public:
+    StackMapIndex();
+    ~StackMapIndex();
+
+    StackMapIndex(const StackMapIndex&) = delete;
+    StackMapIndex& operator=(const StackMapIndex&) = delete;
+
+    /**
+     * Index the call sites of a module. Adding a stackmap that is already
+     * indexed does nothing.
+     * @param stackmap The module's LLVM stackmap section
+     */
+    void add(void* stackmap);
+
+    /**
+     * Forget the call sites of a module. No frame of the module may be on
+     * the stack when it is next walked.
+     * @return False if the stackmap was not indexed
+     */
+    bool remove(void* stackmap);
+
+    /** @return The frame info of the call site returning to return_address, or nullptr */
+    inline frame_info_t* lookup(uint64_t return_address) const {
+        if (count_ == 0) {
+            return nullptr;
+        }
+
+        for (auto i = home_slot(return_address);; i = (i + 1) & mask_) {
+            auto& slot = slots_[i];
+            if (slot.frame == nullptr) {
+                return nullptr;
+            }
+            if (slot.return_address == return_address) {
+                return slot.frame;
+            }
+        }
+    }
+
+    /** @return The number of indexed call sites */
+    size_t size() const { return count_; }
+
+    /** @return The number of indexed stackmaps */
+    size_t module_count() const { return tables_.size(); }
+
+private:
+    struct Slot {
+      uint64_t      return_address;
+      frame_info_t* frame;
+    };
+
+    std::vector<Slot> slots_;
+    size_t            mask_;
+    size_t            count_;
+
+    /** Statepoint tables by the stackmap they were parsed from */
+    std::unordered_map<void*, statepoint_table_t*> tables_;
+
+    inline size_t home_slot(uint64_t return_address) const {
+        // Fibonacci hashing spreads nearby code addresses across the table
+        return static_cast<size_t>((return_address * 0x9E3779B97F4A7C15ULL) >> 32) & mask_;
+    }
+
+    void insert(frame_info_t* frame);
+    void erase(uint64_t return_address);
+    void grow();
+};
+
+}
+
+#endif //ELECTRUM_STACKMAPINDEX_H
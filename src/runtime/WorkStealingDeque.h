@@ -0,0 +1,175 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef ELECTRUM_WORKSTEALINGDEQUE_H
+#define ELECTRUM_WORKSTEALINGDEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace electrum {
+
+/**
+ * A Chase-Lev work stealing deque. The owning thread pushes and pops at
+ * the bottom, other threads steal from the top.
+ *
+ * The buffer grows when full. Old buffers may still be read by a thief,
+ * so they are kept until the deque is destroyed.
+ */
+template<typename T>
+class WorkStealingDeque {
+public:
+    /** @param capacity Initial capacity, which must be a power of two */
+    explicit WorkStealingDeque(int64_t capacity = 1024)
+            :top_(0),
+             bottom_(0),
+             buffer_(new Buffer(capacity)) {
+    }
+
+    ~WorkStealingDeque() {
+        delete buffer_.load(std::memory_order_relaxed);
+        for (auto buffer: retired_) {
+            delete buffer;
+        }
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    /** Push an item. Only called by the owning thread. */
+    void push(T item) {
+        auto bottom = bottom_.load(std::memory_order_relaxed);
+        auto top    = top_.load(std::memory_order_acquire);
+        auto buffer = buffer_.load(std::memory_order_relaxed);
+
+        if (bottom - top > buffer->capacity - 1) {
+            buffer = grow(buffer, bottom, top);
+        }
+
+        buffer->put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Pop the most recently pushed item. Only called by the owning thread.
+     * @return False if the deque was empty
+     */
+    bool pop(T& item) {
+        auto bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        auto buffer = buffer_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto top = top_.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = buffer->get(bottom);
+
+        if (top == bottom) {
+            // Last item, race any thieves for it
+            bool won = top_.compare_exchange_strong(top, top + 1,
+                                                    std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+
+        return true;
+    }
+
+    /**
+     * Take the oldest item. May be called by any thread.
+     * @return False if the deque was empty or another thread got the item first
+     */
+    bool steal(T& item) {
+        auto top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto bottom = bottom_.load(std::memory_order_acquire);
+
+        if (top >= bottom) {
+            return false;
+        }
+
+        auto buffer = buffer_.load(std::memory_order_acquire);
+        item = buffer->get(top);
+
+        return top_.compare_exchange_strong(top, top + 1,
+                                            std::memory_order_seq_cst,
+                                            std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+        auto bottom = bottom_.load(std::memory_order_relaxed);
+        auto top    = top_.load(std::memory_order_relaxed);
+        return bottom <= top;
+    }
+
+private:
+    struct Buffer {
+      int64_t capacity;
+      std::atomic<T>* items;
+
+      explicit Buffer(int64_t capacity)
+              :capacity(capacity),
+               items(new std::atomic<T>[capacity]) {
+      }
+
+      ~Buffer() {
+          delete[] items;
+      }
+
+      T get(int64_t index) const {
+          return items[index & (capacity - 1)].load(std::memory_order_relaxed);
+      }
+
+      void put(int64_t index, T item) {
+          items[index & (capacity - 1)].store(item, std::memory_order_relaxed);
+      }
+    };
+
+    std::atomic<int64_t> top_;
+    std::atomic<int64_t> bottom_;
+    std::atomic<Buffer*> buffer_;
+    std::vector<Buffer*> retired_;
+
+    Buffer* grow(Buffer* buffer, int64_t bottom, int64_t top) {
+        auto larger = new Buffer(buffer->capacity * 2);
+        for (auto i = top; i < bottom; i++) {
+            larger->put(i, buffer->get(i));
+        }
+
+        retired_.push_back(buffer);
+        buffer_.store(larger, std::memory_order_release);
+        return larger;
+    }
+};
+
+}
+
+#endif //ELECTRUM_WORKSTEALINGDEQUE_H
@@ -7,6 +7,11 @@
   (def-ffi-fn* symbol?  rt_is_symbol  :el (:el))
   (def-ffi-fn* keyword? rt_is_keyword :el (:el))
   (def-ffi-fn* string?  rt_is_string  :el (:el))
+  (def-ffi-fn* char?    rt_is_char    :el (:el))
+
+                                        ; Chars
+  (def-ffi-fn* char->integer rt_char_to_integer :el (:el))
+  (def-ffi-fn* integer->char rt_integer_to_char :el (:el))
 
                                         ; List
   (def-ffi-fn* list? rt_is_pair :el (:el))
@@ -36,6 +41,14 @@
   (def-ffi-fn* throw el_rt_throw :el (:el))
   (def-ffi-fn* exception el_rt_make_exception :el (:el :el :el))
 
+                                        ; Garbage collector
+  (def-ffi-fn* gc-stats rt_gc_stats :el ())
+  (def-ffi-fn* gc-request-collection rt_gc_request_collection :el ())
+  (def-ffi-fn* gc-heap-snapshot rt_gc_heap_snapshot :el (:el))
+  (def-ffi-fn* gc-start-allocation-profile rt_gc_start_allocation_profile :el (:el))
+  (def-ffi-fn* gc-stop-allocation-profile rt_gc_stop_allocation_profile :el ())
+  (def-ffi-fn* gc-allocation-profile rt_gc_allocation_profile :el ())
+
   (defmacro defn (name args & body)
     (list 'def name (cons 'lambda (cons args body))))
 
@@ -0,0 +1,130 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/*
+ * Measures the pause of a major collection as the heap and the number of
+ * marking threads grow.
+ *
+ * Usage: GC_Benchmark [max heap objects]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "runtime/Runtime.h"
+#include "runtime/GarbageCollector.h"
+
+using namespace electrum;
+
+/**
+ * Build a complete binary tree of pairs
+ * @param depth Levels of pairs, so the tree holds 2^depth - 1 of them
+ */
+static void* build_tree(size_t depth, int64_t leaf) {
+    if (depth == 0) {
+        return rt_make_integer(leaf);
+    }
+
+    auto left  = build_tree(depth - 1, leaf * 2);
+    auto right = build_tree(depth - 1, leaf * 2 + 1);
+    return rt_make_pair(left, right);
+}
+
+/**
+ * Build many independent binary trees holding num_objects pairs in total,
+ * rooted by a var. Every level of every tree fans out, so the marking
+ * threads always have work to steal.
+ */
+static void* build_heap(size_t num_objects) {
+    const size_t tree_depth   = 12;
+    const size_t tree_objects = (size_t(1) << tree_depth) - 1;
+
+    auto var = rt_make_var(rt_make_symbol("heap"));
+    rt_get_gc()->add_object_root(var);
+
+    auto trees = NIL_PTR;
+    for (size_t made = 0; made < num_objects; made += tree_objects + 1) {
+        trees = rt_make_pair(build_tree(tree_depth, 1), trees);
+        rt_set_var(var, trees);
+    }
+
+    return var;
+}
+
+static double time_major_collection() {
+    auto start = std::chrono::steady_clock::now();
+    rt_get_gc()->collect_major(nullptr);
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    size_t max_objects = 4000000;
+    if (argc > 1) {
+        max_objects = std::strtoul(argv[1], nullptr, 10);
+    }
+
+    const std::vector<size_t> thread_counts = {1, 2, 4, 8};
+    const int repetitions = 5;
+
+    std::printf("%12s", "objects");
+    for (auto threads: thread_counts) {
+        std::printf("  %7zu thr", threads);
+    }
+    std::printf("   (major GC pause, ms)\n");
+
+    for (size_t num_objects = 100000; num_objects <= max_objects; num_objects *= 2) {
+        std::printf("%12zu", num_objects);
+
+        for (auto threads: thread_counts) {
+            GCConfig config;
+            config.marker_threads = threads;
+            rt_init_gc(kGCModeInterpreterOwned, config);
+
+            build_heap(num_objects);
+
+            // The first collection promotes the heap out of the nursery
+            time_major_collection();
+
+            double best = 0;
+            for (int i = 0; i < repetitions; i++) {
+                auto pause = time_major_collection();
+                if (i == 0 || pause < best) {
+                    best = pause;
+                }
+            }
+
+            std::printf("  %11.2f", best);
+            std::fflush(stdout);
+
+            rt_deinit_gc();
+        }
+
+        std::printf("\n");
+    }
+
+    return 0;
+}
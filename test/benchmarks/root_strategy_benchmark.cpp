@@ -0,0 +1,140 @@
+/*
+ MIT License
+
+ Copyright (c) 2018 Andy Best
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+/*
+ * Compares the GC root strategies of the compiler: statepoint stack maps
+ * and the shadow stack. For each strategy it measures how long it takes to
+ * compile a batch of functions, and how long an allocation heavy loop
+ * runs once compiled.
+ *
+ * Usage: Root_Strategy_Benchmark [functions compiled] [loop iterations]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "compiler/Compiler.h"
+#include "runtime/Runtime.h"
+#include "runtime/GarbageCollector.h"
+
+using namespace electrum;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void define_primitives(Compiler& c) {
+    c.compileAndEvalString("(def-ffi-fn* + rt_add :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* eq? rt_eq :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* not rt_not :el (:el))");
+    c.compileAndEvalString("(def-ffi-fn* cons rt_make_pair :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* car rt_car :el (:el))");
+    c.compileAndEvalString("(def-ffi-fn* cdr rt_cdr :el (:el))");
+}
+
+/**
+ * @return Milliseconds spent compiling and loading num_functions definitions
+ */
+static double time_compile(Compiler& c, int num_functions) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < num_functions; i++) {
+        std::stringstream ss;
+        ss << "(def f" << i << " (lambda (a b)"
+           << "  (let ((l (cons a (cons b nil))))"
+           << "    (while (not (eq? a b))"
+           << "      (set! a (+ a 1))"
+           << "      (set! l (cons a l)))"
+           << "    (car (cdr l)))))";
+        c.compileAndEvalString(ss.str());
+    }
+
+    return elapsed_ms(start);
+}
+
+/**
+ * @return Milliseconds spent running a loop that conses two pairs per
+ * iteration, keeping only the last two alive
+ */
+static double time_run(Compiler& c, long iterations) {
+    c.compileAndEvalString("(def churn (lambda (n)"
+                           "  (let ((i 0)"
+                           "        (window (cons 0 nil)))"
+                           "    (while (not (eq? i n))"
+                           "      (set! window (cons i (cons (car window) nil)))"
+                           "      (set! i (+ i 1)))"
+                           "    i)))");
+
+    std::stringstream ss;
+    ss << "(churn " << iterations << ")";
+
+    auto start = std::chrono::steady_clock::now();
+    c.compileAndEvalString(ss.str());
+    return elapsed_ms(start);
+}
+
+int main(int argc, char** argv) {
+    int  num_functions = 200;
+    long iterations    = 5000000;
+    if (argc > 1) {
+        num_functions = std::atoi(argv[1]);
+    }
+    if (argc > 2) {
+        iterations = std::atol(argv[2]);
+    }
+
+    const std::vector<std::shared_ptr<GCRootStrategy>> strategies = {
+            std::make_shared<StackMapRootStrategy>(),
+            std::make_shared<ShadowStackRootStrategy>()
+    };
+
+    std::printf("%14s  %14s  %14s  %14s\n", "strategy", "compile (ms)", "fn/s", "run (ms)");
+
+    for (const auto& strategy: strategies) {
+        rt_init_gc(kGCModeInterpreterOwned);
+
+        {
+            Compiler c(strategy);
+            define_primitives(c);
+
+            auto compile_ms = time_compile(c, num_functions);
+            auto run_ms     = time_run(c, iterations);
+
+            std::printf("%14s  %14.1f  %14.1f  %14.1f\n",
+                        strategy->name(),
+                        compile_ms,
+                        num_functions / (compile_ms / 1000.0),
+                        run_ms);
+            std::fflush(stdout);
+        }
+
+        rt_deinit_gc();
+    }
+
+    return 0;
+}
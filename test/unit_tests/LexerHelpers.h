@@ -46,6 +46,7 @@ std::string tokenTypeName(TokenType type) {
         case kTokenTypeEOF: return "kTokenTypeEOF";
         case kTokenTypeKeyword: return "kTokenTypeKeyword";
         case kTokenTypeString: return "kTokenTypeString";
+        case kTokenTypeChar: return "kTokenTypeChar";
         case kTokenTypeBoolean: return "kTokenTypeBoolean";
         case kTokenTypeNil: return "kTokenTypeNil";
     }
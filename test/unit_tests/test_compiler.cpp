@@ -104,6 +104,27 @@ TEST(Compiler, compilesConstantKeyword) {
     rt_deinit_gc();
 }
 
+TEST(Compiler, compilesConstantChar) {
+    rt_init_gc(kGCModeInterpreterOwned);
+
+    Compiler c;
+    auto     result = c.compileAndEvalString("#\\a");
+
+    EXPECT_EQ(rt_is_char(result), TRUE_PTR);
+    EXPECT_EQ(rt_char_value(result), 'a');
+
+    c.compileAndEvalString("(def-ffi-fn* char->integer rt_char_to_integer :el (:el))");
+    c.compileAndEvalString("(def-ffi-fn* integer->char rt_integer_to_char :el (:el))");
+
+    auto result2 = c.compileAndEvalString("(char->integer #\\space)");
+    EXPECT_EQ(rt_integer_value(result2), ' ');
+
+    auto result3 = c.compileAndEvalString("(integer->char 9786)");
+    EXPECT_EQ(result3, rt_make_char(0x263A));
+
+    rt_deinit_gc();
+}
+
 TEST(Compiler, compilesIf) {
     rt_init_gc(kGCModeInterpreterOwned);
 
@@ -755,4 +776,201 @@ TEST(Compiler, macroExpansionDoesNotDisruptLocalEnvironment) {
     EXPECT_NO_THROW(c.compileAndEvalString("(def f (lambda (x) (identity 1) x))"));
 
     rt_deinit_gc();
-}
\ No newline at end of file
+}
+
+TEST(Compiler, shadowStackStrategyKeepsValuesAliveAcrossCollections) {
+    GCConfig config;
+    config.nursery_size = 256 * 1024;
+    config.allocation_budget = 64 * 1024;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    {
+        Compiler c(std::make_shared<ShadowStackRootStrategy>());
+        c.compileAndEvalString("(def-ffi-fn* + rt_add :el (:el :el))");
+        c.compileAndEvalString("(def-ffi-fn* eq? rt_eq :el (:el :el))");
+        c.compileAndEvalString("(def-ffi-fn* not rt_not :el (:el))");
+        c.compileAndEvalString("(def-ffi-fn* cons rt_make_pair :el (:el :el))");
+        c.compileAndEvalString("(def-ffi-fn* car rt_car :el (:el))");
+
+        // Enough garbage for many collections while the list is held
+        // only by the loop
+        auto r1 = c.compileAndEvalString("(let ((a 0)"
+                                         "      (l nil))"
+                                         "  (while (not (eq? a 20000))"
+                                         "    (cons a (cons a nil))"
+                                         "    (set! l (cons a l))"
+                                         "    (set! a (+ a 1)))"
+                                         "  (car l))");
+
+        EXPECT_EQ(rt_is_integer(r1), TRUE_PTR);
+        EXPECT_EQ(rt_integer_value(r1), 19999);
+    }
+
+    rt_deinit_gc();
+}
+
+TEST(Compiler, shadowStackStrategyKeepsValuesAliveAcrossNestedCalls) {
+    GCConfig config;
+    config.nursery_size = 256 * 1024;
+    config.allocation_budget = 64 * 1024;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    {
+        Compiler c(std::make_shared<ShadowStackRootStrategy>());
+        c.compileAndEvalString("(def-ffi-fn* + rt_add :el (:el :el))");
+        c.compileAndEvalString("(def-ffi-fn* eq? rt_eq :el (:el :el))");
+        c.compileAndEvalString("(def-ffi-fn* not rt_not :el (:el))");
+        c.compileAndEvalString("(def-ffi-fn* cons rt_make_pair :el (:el :el))");
+        c.compileAndEvalString("(def-ffi-fn* car rt_car :el (:el))");
+
+        // f's frame on the root stack holds x while g, called through the
+        // runtime, allocates enough for several collections
+        c.compileAndEvalString("(def g (lambda ()"
+                               "  (let ((a 0))"
+                               "    (while (not (eq? a 20000))"
+                               "      (cons a nil)"
+                               "      (set! a (+ a 1))))))");
+        c.compileAndEvalString("(def f (lambda (x) (g) (car x)))");
+
+        auto r1 = c.compileAndEvalString("(f (cons 1234 nil))");
+
+        EXPECT_EQ(rt_is_integer(r1), TRUE_PTR);
+        EXPECT_EQ(rt_integer_value(r1), 1234);
+    }
+
+    rt_deinit_gc();
+}
+
+TEST(Compiler, shadowStackStrategyKeepsLoopCarriedValuesAlive) {
+    GCConfig config;
+    config.nursery_size = 256 * 1024;
+    config.allocation_budget = 64 * 1024;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    {
+        Compiler c(std::make_shared<ShadowStackRootStrategy>());
+        c.compileAndEvalString("(def-ffi-fn* + rt_add :el (:el :el))");
+        c.compileAndEvalString("(def-ffi-fn* eq? rt_eq :el (:el :el))");
+        c.compileAndEvalString("(def-ffi-fn* not rt_not :el (:el))");
+        c.compileAndEvalString("(def-ffi-fn* cons rt_make_pair :el (:el :el))");
+        c.compileAndEvalString("(def-ffi-fn* car rt_car :el (:el))");
+
+        // Once optimised, y is the phi carrying the previous iteration's
+        // x, whose call result slot is refilled before the garbage is made
+        auto r1 = c.compileAndEvalString("(let ((a 0)"
+                                         "      (s 0)"
+                                         "      (x (cons 0 nil))"
+                                         "      (y nil))"
+                                         "  (while (not (eq? a 20000))"
+                                         "    (set! y x)"
+                                         "    (set! x (cons a nil))"
+                                         "    (cons a (cons a nil))"
+                                         "    (set! s (+ s (car y)))"
+                                         "    (set! a (+ a 1)))"
+                                         "  s)");
+
+        EXPECT_EQ(rt_is_integer(r1), TRUE_PTR);
+        EXPECT_EQ(rt_integer_value(r1), 199970001);
+    }
+
+    rt_deinit_gc();
+}
+
+TEST(Compiler, valuesHeldAcrossNestedCallsSurviveCollections) {
+    GCConfig config;
+    config.nursery_size = 256 * 1024;
+    config.allocation_budget = 64 * 1024;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    Compiler c;
+    c.compileAndEvalString("(def-ffi-fn* + rt_add :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* eq? rt_eq :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* not rt_not :el (:el))");
+    c.compileAndEvalString("(def-ffi-fn* cons rt_make_pair :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* car rt_car :el (:el))");
+
+    // g allocates enough for several collections. f holds x in its own frame
+    // across the call, which is made through the runtime.
+    c.compileAndEvalString("(def g (lambda ()"
+                           "  (let ((a 0))"
+                           "    (while (not (eq? a 20000))"
+                           "      (cons a nil)"
+                           "      (set! a (+ a 1))))))");
+    c.compileAndEvalString("(def f (lambda (x) (g) (car x)))");
+
+    auto r = c.compileAndEvalString("(f (cons 1234 nil))");
+
+    EXPECT_EQ(rt_is_integer(r), TRUE_PTR);
+    EXPECT_EQ(rt_integer_value(r), 1234);
+
+    rt_deinit_gc();
+}
+
+TEST(Compiler, valuesRelocatedAtSafepointsStayValid) {
+    GCConfig config;
+    config.nursery_size = 256 * 1024;
+    config.allocation_budget = 64 * 1024;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    Compiler c;
+    c.compileAndEvalString("(def-ffi-fn* + rt_add :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* eq? rt_eq :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* not rt_not :el (:el))");
+    c.compileAndEvalString("(def-ffi-fn* cons rt_make_pair :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* car rt_car :el (:el))");
+
+    // x is only held in the frame that polls, which the stack map
+    // describes, so each collection copies it and relocates the slot.
+    // A stale slot would point at memory the loop has reused.
+    auto r = c.compileAndEvalString("(let ((x (cons 1234 nil))"
+                                    "      (a 0))"
+                                    "  (while (not (eq? a 20000))"
+                                    "    (cons a nil)"
+                                    "    (set! a (+ a 1)))"
+                                    "  (car x))");
+
+    EXPECT_EQ(rt_is_integer(r), TRUE_PTR);
+    EXPECT_EQ(rt_integer_value(r), 1234);
+
+    GCStats stats;
+    rt_gc_get_stats(&stats);
+    EXPECT_GT(stats.minor_collections, 0);
+
+    rt_deinit_gc();
+}
+
+TEST(Compiler, collectionRequestedInNestedFrameRunsAtItsPoll) {
+    rt_init_gc(kGCModeInterpreterOwned);
+
+    Compiler c;
+    c.compileAndEvalString("(def-ffi-fn* + rt_add :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* eq? rt_eq :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* not rt_not :el (:el))");
+    c.compileAndEvalString("(def-ffi-fn* cons rt_make_pair :el (:el :el))");
+    c.compileAndEvalString("(def-ffi-fn* car rt_car :el (:el))");
+    c.compileAndEvalString("(def-ffi-fn* gc-request-collection rt_gc_request_collection :el ())");
+
+    // g is called through the runtime, and collects at the first poll of
+    // its loop while f still holds x
+    c.compileAndEvalString("(def g (lambda ()"
+                           "  (gc-request-collection)"
+                           "  (let ((a 0))"
+                           "    (while (not (eq? a 10))"
+                           "      (set! a (+ a 1))))))");
+    c.compileAndEvalString("(def f (lambda (x) (g) (car x)))");
+
+    GCStats before;
+    rt_gc_get_stats(&before);
+
+    auto r = c.compileAndEvalString("(f (cons 1234 nil))");
+
+    EXPECT_EQ(rt_is_integer(r), TRUE_PTR);
+    EXPECT_EQ(rt_integer_value(r), 1234);
+
+    GCStats after;
+    rt_gc_get_stats(&after);
+    EXPECT_GT(after.minor_collections + after.major_collections, before.minor_collections + before.major_collections);
+    EXPECT_FALSE(rt_get_gc()->collection_requested());
+
+    rt_deinit_gc();
+}
@@ -27,9 +27,41 @@
 #include "types/Types.h"
 #include "runtime/Runtime.h"
 #include "runtime/GarbageCollector.h"
+#include "runtime/ObjectLayout.h"
+#include "runtime/StackMapIndex.h"
+#include "runtime/stackmap/stackmap.h"
+#include "runtime/WorkStealingDeque.h"
+#include "heap_analyzer/HeapGraph.h"
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <thread>
+#include <sys/mman.h>
 
 using namespace electrum;
 
+/**
+ * Gives each test a fresh interpreter owned collector, and destroys it when
+ * the test ends, even if an assertion fails.
+ */
+class GCTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        rt_init_gc(kGCModeInterpreterOwned);
+    }
+
+    void TearDown() override {
+        rt_deinit_gc();
+    }
+
+    /** Replace the collector with one using other settings */
+    void restart_gc(const GCConfig& config, GCMode mode = kGCModeInterpreterOwned) {
+        rt_deinit_gc();
+        rt_init_gc(mode, config);
+    }
+};
+
 /*
 TEST(GC, does_not_collect_root_object) {
     rt_init_gc(kGCModeInterpreterOwned);
@@ -65,4 +97,1377 @@ TEST(GC, collects_correct_object) {
 
     // This should not crash
     EXPECT_FLOAT_EQ(rt_float_value(f1), 1.234);
-}*/
\ No newline at end of file
+}*/
+
+TEST_F(GCTest, minor_collection_preserves_rooted_objects) {
+    auto list = rt_make_pair(rt_make_float(1.5), rt_make_pair(rt_make_integer(2), NIL_PTR));
+    rt_get_gc()->add_object_root(list);
+
+    for (int i = 0; i < 4; i++) {
+        // Garbage that should not disturb the rooted list
+        rt_make_pair(rt_make_float(i), NIL_PTR);
+        rt_get_gc()->collect_minor(nullptr);
+    }
+
+    EXPECT_DOUBLE_EQ(rt_float_value(rt_car(list)), 1.5);
+    EXPECT_EQ(rt_integer_value(rt_car(rt_cdr(list))), 2);
+    EXPECT_EQ(rt_cdr(rt_cdr(list)), NIL_PTR);
+}
+
+TEST_F(GCTest, write_barrier_keeps_young_objects_alive) {
+    auto pair = rt_make_pair(NIL_PTR, NIL_PTR);
+    rt_get_gc()->add_object_root(pair);
+
+    // The rooted pair can't move, so its block is eventually tenured in place
+    rt_get_gc()->collect_minor(nullptr);
+    rt_get_gc()->collect_minor(nullptr);
+    EXPECT_FALSE(rt_get_gc()->is_young(pair));
+
+    // Large enough to be boxed rather than an immediate
+    auto f = rt_make_float(3.25e300);
+    EXPECT_TRUE(rt_get_gc()->is_young(f));
+
+    // Only the old pair refers to the float
+    rt_set_car(pair, f);
+    rt_get_gc()->collect_minor(nullptr);
+
+    EXPECT_NE(rt_car(pair), f);
+    EXPECT_DOUBLE_EQ(rt_float_value(rt_car(pair)), 3.25e300);
+
+    // Survivors are promoted once they reach the tenure age
+    rt_get_gc()->collect_minor(nullptr);
+    EXPECT_FALSE(rt_get_gc()->is_young(rt_car(pair)));
+    EXPECT_DOUBLE_EQ(rt_float_value(rt_car(pair)), 3.25e300);
+}
+
+TEST_F(GCTest, major_collection_preserves_rooted_objects) {
+    auto var = rt_make_var(rt_make_symbol("test"));
+    rt_get_gc()->add_object_root(var);
+
+    auto list = NIL_PTR;
+    for (int i = 0; i < 100; i++) {
+        list = rt_make_pair(rt_make_integer(i), list);
+    }
+    rt_set_var(var, list);
+
+    rt_get_gc()->collect_major(nullptr);
+    rt_get_gc()->collect_major(nullptr);
+
+    auto current = rt_deref_var(var);
+    for (int i = 99; i >= 0; i--) {
+        EXPECT_EQ(rt_integer_value(rt_car(current)), i);
+        current = rt_cdr(current);
+    }
+    EXPECT_EQ(current, NIL_PTR);
+}
+
+TEST(PageAllocator, allocates_same_size_class_contiguously) {
+    PageAllocator allocator;
+
+    auto a = static_cast<uint8_t*>(allocator.allocate(sizeof(EPair)));
+    auto b = static_cast<uint8_t*>(allocator.allocate(sizeof(EPair)));
+    auto f = static_cast<uint8_t*>(allocator.allocate(sizeof(EFloat)));
+
+    EXPECT_EQ(b - a, allocator.cell_size(sizeof(EPair)));
+    EXPECT_EQ(PageAllocator::page_of(a), PageAllocator::page_of(b));
+    EXPECT_NE(PageAllocator::page_of(a), PageAllocator::page_of(f));
+}
+
+TEST(PageAllocator, reuses_dead_cells) {
+    PageAllocator allocator;
+
+    std::vector<EPair*> pairs;
+    for (int i = 0; i < 10; i++) {
+        auto pair = static_cast<EPair*>(allocator.allocate(sizeof(EPair)));
+        pair->header.tag = kETypeTagPair;
+        pair->value = rt_make_integer(i);
+        pairs.push_back(pair);
+    }
+
+    for (auto pair: pairs) {
+        if (rt_integer_value(pair->value) % 2 == 0) {
+            PageAllocator::mark(pair);
+        }
+    }
+
+    EXPECT_TRUE(PageAllocator::is_marked(pairs[0]));
+    EXPECT_FALSE(PageAllocator::is_marked(pairs[1]));
+    allocator.begin_sweep();
+
+    // The page is swept on demand, and its first dead cell handed out again
+    EXPECT_EQ(allocator.allocate(sizeof(EPair)), pairs[1]);
+    EXPECT_EQ(allocator.page_count(), 1);
+}
+
+TEST(PageAllocator, releases_empty_pages) {
+    PageAllocator allocator;
+
+    for (int i = 0; i < 1000; i++) {
+        allocator.allocate(sizeof(EPair));
+    }
+    EXPECT_GT(allocator.page_count(), 1);
+
+    allocator.begin_sweep();
+    EXPECT_GT(allocator.page_count(), 1);
+
+    EXPECT_EQ(allocator.finish_sweep(), 1000);
+    EXPECT_EQ(allocator.page_count(), 0);
+}
+
+TEST(PageAllocator, keeps_a_few_empty_pages_resident) {
+    PageAllocator allocator;
+
+    std::vector<Page*> pages;
+    while (pages.size() < kResidentFreePages * 3) {
+        auto page = PageAllocator::page_of(allocator.allocate(sizeof(EPair)));
+        if (std::find(pages.begin(), pages.end(), page) == pages.end()) {
+            pages.push_back(page);
+        }
+    }
+
+    // Nothing is released until the sweep is over
+    allocator.begin_sweep();
+    EXPECT_EQ(allocator.resident_free_page_count(), 0);
+    allocator.finish_sweep();
+    EXPECT_EQ(allocator.page_count(), 0);
+    EXPECT_EQ(allocator.resident_free_page_count(), kResidentFreePages);
+
+    std::vector<Page*> resident;
+    for (auto page: pages) {
+        unsigned char in_core = 0;
+        ASSERT_EQ(mincore(page, 1, &in_core), 0);
+        if (in_core & 1) {
+            resident.push_back(page);
+        }
+    }
+    EXPECT_EQ(resident.size(), kResidentFreePages);
+
+    // The resident pages are reused first
+    auto reused = PageAllocator::page_of(allocator.allocate(sizeof(EPair)));
+    EXPECT_NE(std::find(resident.begin(), resident.end(), reused), resident.end());
+    EXPECT_EQ(allocator.resident_free_page_count(), kResidentFreePages - 1);
+}
+
+TEST(LargeObjectSpace, unmaps_unmarked_objects) {
+    LargeObjectSpace space;
+
+    auto large = space.allocate(kMaxSmallObjectSize * 4);
+    space.allocate(1024 * 1024);
+    EXPECT_EQ(space.object_count(), 2);
+    EXPECT_GE(space.mapped_bytes(), 1024 * 1024 + kMaxSmallObjectSize * 4);
+
+    // Objects are page aligned, and can be marked like small objects
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(PageAllocator::page_of(large)) + kPageHeaderSize,
+              reinterpret_cast<uintptr_t>(large));
+    memset(large, 0xAB, kMaxSmallObjectSize * 4);
+
+    PageAllocator::mark(large);
+    EXPECT_EQ(space.sweep(), 1);
+    EXPECT_EQ(space.object_count(), 1);
+    EXPECT_LT(space.mapped_bytes(), 1024 * 1024);
+
+    // Marks are cleared by the sweep
+    EXPECT_FALSE(PageAllocator::is_marked(large));
+}
+
+TEST(GC, major_collection_keeps_rooted_large_objects) {
+    rt_init_gc(kGCModeInterpreterOwned);
+
+    std::string text(3 * kMaxSmallObjectSize, 'a');
+    auto kept = rt_make_string(text.c_str());
+    rt_get_gc()->add_object_root(kept);
+    rt_make_string(text.c_str());
+
+    rt_get_gc()->collect_major(nullptr);
+
+    EXPECT_EQ(std::string(rt_string_value(kept)), text);
+
+    rt_deinit_gc();
+}
+
+TEST(WorkStealingDeque, each_item_is_taken_once) {
+    WorkStealingDeque<intptr_t> deque(16);
+    std::atomic<int64_t> total(0);
+    std::atomic<bool> done(false);
+
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < 3; i++) {
+        thieves.emplace_back([&] {
+          intptr_t item;
+          while (!done.load() || !deque.empty()) {
+              if (deque.steal(item)) {
+                  total += item;
+              }
+          }
+        });
+    }
+
+    int64_t expected = 0;
+    for (intptr_t i = 1; i <= 100000; i++) {
+        deque.push(i);
+        expected += i;
+
+        intptr_t item;
+        if (i % 3 == 0 && deque.pop(item)) {
+            total += item;
+        }
+    }
+
+    done = true;
+    for (auto& thief: thieves) {
+        thief.join();
+    }
+
+    EXPECT_EQ(total.load(), expected);
+}
+
+TEST(GC, parallel_marking_preserves_object_graph) {
+    GCConfig config;
+    config.marker_threads = 4;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto var = rt_make_var(rt_make_symbol("tree"));
+    rt_get_gc()->add_object_root(var);
+
+    // A wide tree, so that there is work to steal
+    auto tree = NIL_PTR;
+    for (int i = 0; i < 200; i++) {
+        auto branch = NIL_PTR;
+        for (int j = 0; j < 100; j++) {
+            branch = rt_make_pair(rt_make_integer(j), branch);
+        }
+        tree = rt_make_pair(branch, tree);
+    }
+    rt_set_var(var, tree);
+
+    rt_get_gc()->collect_major(nullptr);
+    rt_get_gc()->collect_major(nullptr);
+
+    int64_t sum = 0;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        for (auto leaf = rt_car(node); leaf != NIL_PTR; leaf = rt_cdr(leaf)) {
+            sum += rt_integer_value(rt_car(leaf));
+        }
+    }
+    EXPECT_EQ(sum, 200 * (99 * 100 / 2));
+
+    rt_deinit_gc();
+}
+
+TEST(PageAllocator, background_sweeper_frees_dead_cells) {
+    PageAllocator allocator(true);
+
+    std::vector<void*> cells;
+    for (int i = 0; i < 5000; i++) {
+        cells.push_back(allocator.allocate(sizeof(EPair)));
+    }
+
+    // Keep every tenth cell
+    for (size_t i = 0; i < cells.size(); i += 10) {
+        PageAllocator::mark(cells[i]);
+    }
+
+    allocator.begin_sweep();
+
+    // Allocation during the sweep only ever returns dead cells
+    for (int i = 0; i < 100; i++) {
+        auto cell = allocator.allocate(sizeof(EPair));
+        auto index = std::find(cells.begin(), cells.end(), cell) - cells.begin();
+        if (index < cells.size()) {
+            EXPECT_NE(index % 10, 0);
+        }
+    }
+
+    EXPECT_EQ(allocator.finish_sweep(), 4500);
+}
+
+TEST(GC, incremental_marking_keeps_objects_moved_while_marking) {
+    GCConfig config;
+    config.incremental_marking = true;
+    config.max_pause_us = 1;
+    config.major_collection_threshold = 0;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto var = rt_make_var(rt_make_symbol("tree"));
+    rt_get_gc()->add_object_root(var);
+
+    auto tree = NIL_PTR;
+    for (int i = 0; i < 100; i++) {
+        auto branch = NIL_PTR;
+        for (int j = 0; j < 100; j++) {
+            branch = rt_make_pair(rt_make_integer(j), branch);
+        }
+        tree = rt_make_pair(branch, tree);
+    }
+    rt_set_var(var, tree);
+
+    rt_get_gc()->collect(nullptr);
+    ASSERT_TRUE(rt_get_gc()->is_marking());
+
+    // Detach every branch from the tree and rebuild the tree from new pairs,
+    // so the only path to each branch is created after marking started.
+    auto rebuilt = NIL_PTR;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        auto branch = rt_car(node);
+        rt_set_car(node, NIL_PTR);
+        rebuilt = rt_make_pair(branch, rebuilt);
+    }
+    rt_set_var(var, rebuilt);
+
+    int slices = 1;
+    while (rt_get_gc()->is_marking()) {
+        rt_get_gc()->collect(nullptr);
+        slices++;
+    }
+    EXPECT_GT(slices, 2);
+
+    // Allocate enough to reuse any cells that were wrongly freed
+    for (int i = 0; i < 20000; i++) {
+        rt_make_pair(rt_make_integer(-1), NIL_PTR);
+    }
+    rt_get_gc()->collect_major(nullptr);
+
+    int64_t sum = 0;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        for (auto leaf = rt_car(node); leaf != NIL_PTR; leaf = rt_cdr(leaf)) {
+            sum += rt_integer_value(rt_car(leaf));
+        }
+    }
+    EXPECT_EQ(sum, 100 * (99 * 100 / 2));
+
+    rt_deinit_gc();
+}
+
+TEST_F(GCTest, incremental_marking_compacts_sparse_pages_in_its_final_pause) {
+    GCConfig config;
+    config.incremental_marking = true;
+    config.max_pause_us = 1;
+    config.major_collection_threshold = 0;
+    config.background_sweep = false;
+    config.tenure_age = 1000;
+    restart_gc(config);
+
+    auto var = rt_make_var(rt_make_symbol("list"));
+    rt_get_gc()->add_object_root(var);
+
+    auto list = NIL_PTR;
+    for (int i = 0; i < 4000; i++) {
+        list = rt_make_pair(rt_make_integer(i), list);
+    }
+    rt_set_var(var, list);
+    rt_get_gc()->collect_major(nullptr);
+
+    // Keep one pair in ten, so every page is left mostly empty
+    std::vector<void*> survivors;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        survivors.push_back(node);
+
+        auto next = rt_cdr(node);
+        for (int i = 0; i < 9 && next != NIL_PTR; i++) {
+            next = rt_cdr(next);
+        }
+        rt_set_cdr(node, next);
+    }
+
+    auto pinned = survivors[survivors.size() / 2];
+    rt_gc_pin(pinned);
+
+    // Grow the old generation past the next major threshold with garbage
+    std::string text(3 * kMaxSmallObjectSize, 'a');
+    for (int i = 0; i < 100; i++) {
+        rt_make_string(text.c_str());
+    }
+
+    rt_get_gc()->collect(nullptr);
+    ASSERT_TRUE(rt_get_gc()->is_marking());
+
+    // A young root made while marking stays in the nursery, but its field
+    // must follow the object it refers to
+    auto holder = rt_make_pair(survivors[1], NIL_PTR);
+    rt_get_gc()->add_object_root(holder);
+    ASSERT_TRUE(rt_get_gc()->is_young(holder));
+
+    while (rt_get_gc()->is_marking()) {
+        rt_get_gc()->collect(nullptr);
+    }
+
+    std::vector<void*> nodes;
+    int64_t expected = 3999;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        EXPECT_EQ(rt_integer_value(rt_car(node)), expected);
+        expected -= 10;
+        nodes.push_back(node);
+    }
+
+    ASSERT_EQ(nodes.size(), survivors.size());
+
+    size_t moved = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i] != survivors[i]) {
+            moved++;
+        }
+    }
+
+    EXPECT_GT(moved, survivors.size() / 2);
+    EXPECT_EQ(nodes[survivors.size() / 2], pinned);
+    EXPECT_TRUE(rt_get_gc()->is_young(holder));
+    EXPECT_EQ(rt_car(holder), nodes[1]);
+    EXPECT_EQ(rt_integer_value(rt_car(rt_car(holder))), 3989);
+
+    rt_gc_unpin(pinned);
+}
+
+TEST(GC, polls_collect_only_when_the_allocation_budget_is_spent) {
+    GCConfig config;
+    config.tenure_age = 1;
+    config.allocation_budget = 64 * 1024;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto pair = rt_make_pair(rt_make_integer(1), NIL_PTR);
+    rt_get_gc()->add_object_root(pair);
+
+    rt_enter_gc_impl(nullptr);
+    EXPECT_FALSE(rt_get_gc()->collection_requested());
+    EXPECT_TRUE(rt_get_gc()->is_young(pair));
+
+    for (int i = 0; i < 4096; i++) {
+        rt_make_pair(rt_make_integer(i), NIL_PTR);
+    }
+
+    EXPECT_TRUE(rt_get_gc()->collection_requested());
+    rt_enter_gc_impl(nullptr);
+    EXPECT_FALSE(rt_get_gc()->collection_requested());
+
+    EXPECT_FALSE(rt_get_gc()->is_young(pair));
+
+    rt_deinit_gc();
+}
+
+TEST(GC, major_collection_compacts_sparse_pages_except_pinned_objects) {
+    GCConfig config;
+    config.background_sweep = false;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto var = rt_make_var(rt_make_symbol("list"));
+    rt_get_gc()->add_object_root(var);
+
+    auto list = NIL_PTR;
+    for (int i = 0; i < 4000; i++) {
+        list = rt_make_pair(rt_make_integer(i), list);
+    }
+    rt_set_var(var, list);
+    rt_get_gc()->collect_major(nullptr);
+
+    // Keep one pair in ten, so every page is left mostly empty
+    std::vector<void*> survivors;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        survivors.push_back(node);
+
+        auto next = rt_cdr(node);
+        for (int i = 0; i < 9 && next != NIL_PTR; i++) {
+            next = rt_cdr(next);
+        }
+        rt_set_cdr(node, next);
+    }
+
+    auto pinned = survivors[survivors.size() / 2];
+    rt_gc_pin(pinned);
+
+    rt_get_gc()->collect_major(nullptr);
+
+    std::vector<void*> nodes;
+    int64_t expected = 3999;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        EXPECT_EQ(rt_integer_value(rt_car(node)), expected);
+        expected -= 10;
+        nodes.push_back(node);
+    }
+
+    ASSERT_EQ(nodes.size(), survivors.size());
+
+    size_t moved = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i] != survivors[i]) {
+            moved++;
+        }
+    }
+
+    EXPECT_GT(moved, survivors.size() / 2);
+    EXPECT_EQ(nodes[survivors.size() / 2], pinned);
+
+    rt_gc_unpin(pinned);
+    rt_deinit_gc();
+}
+
+TEST(GC, root_stack_keeps_objects_alive_until_popped) {
+    GCConfig config;
+    config.background_sweep = false;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto saved_top = rt_gc_root_stack_top;
+    void* pair = nullptr;
+
+    {
+        RootStackScope scope;
+        pair = rt_make_pair(rt_make_integer(42), rt_make_pair(rt_make_integer(43), NIL_PTR));
+        rt_gc_push_root(pair);
+
+        rt_get_gc()->collect_major(nullptr);
+        for (int i = 0; i < 10000; i++) {
+            rt_make_pair(rt_make_integer(-1), NIL_PTR);
+        }
+        rt_get_gc()->collect_major(nullptr);
+
+        EXPECT_EQ(rt_integer_value(rt_car(pair)), 42);
+        EXPECT_EQ(rt_integer_value(rt_car(rt_cdr(pair))), 43);
+        EXPECT_EQ(rt_gc_root_stack_top, saved_top + 1);
+    }
+
+    EXPECT_EQ(rt_gc_root_stack_top, saved_top);
+
+    rt_gc_push_root(rt_make_integer(1));
+    rt_gc_pop_root();
+    EXPECT_EQ(rt_gc_root_stack_top, saved_top);
+
+    rt_deinit_gc();
+}
+
+TEST(GC, soft_heap_limit_makes_collections_major) {
+    GCConfig config;
+    config.nursery_size = 256 * 1024;
+    config.soft_heap_limit = config.nursery_size + 256 * 1024;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    // Fill the nursery, then spill garbage into the old generation
+    for (int i = 0; i < 40000; i++) {
+        rt_make_pair(rt_make_integer(i), NIL_PTR);
+    }
+    EXPECT_GT(rt_get_gc()->heap_size(), config.soft_heap_limit);
+    EXPECT_TRUE(rt_get_gc()->collection_requested());
+
+    rt_enter_gc_impl(nullptr);
+    EXPECT_LT(rt_get_gc()->heap_size(), config.soft_heap_limit);
+
+    rt_deinit_gc();
+}
+
+TEST(GC, hard_heap_limit_throws_out_of_memory) {
+    GCConfig config;
+    config.nursery_size = 256 * 1024;
+    config.hard_heap_limit = config.nursery_size + 1024 * 1024;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto var = rt_make_var(rt_make_symbol("list"));
+    rt_get_gc()->add_object_root(var);
+
+    bool thrown = false;
+    try {
+        for (int i = 0; i < 1000000; i++) {
+            rt_set_var(var, rt_make_pair(rt_make_integer(i), rt_deref_var(var)));
+        }
+    }
+    catch (...) {
+        thrown = true;
+    }
+
+    EXPECT_TRUE(thrown);
+    EXPECT_LE(rt_get_gc()->heap_size(), config.hard_heap_limit + 1024);
+
+    rt_deinit_gc();
+}
+
+TEST(GC, object_layouts_describe_runtime_types) {
+    rt_init_gc(kGCModeInterpreterOwned);
+
+    auto str = TAG_TO_OBJECT(rt_make_string("hello world"));
+    EXPECT_EQ(object_size(str), sizeof(EString) + 12);
+
+    auto env = rt_make_environment(NIL_PTR);
+    auto fn = rt_make_interpreted_function(NIL_PTR, 0, NIL_PTR, env);
+
+    std::vector<void*> fields;
+    visit_pointer_fields(TAG_TO_OBJECT(fn), [&](void** field) {
+      fields.push_back(*field);
+    });
+    ASSERT_EQ(fields.size(), 3);
+    EXPECT_EQ(fields[2], env);
+
+    rt_deinit_gc();
+}
+
+TEST(GC, registered_layouts_are_traced) {
+    GCConfig config;
+    config.background_sweep = false;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    struct EBox {
+      EObjectHeader header;
+      uint64_t      flags;
+      void*         value;
+    };
+
+    const uint32_t box_tag = 20;
+    ObjectLayout layout = {"box", sizeof(EBox), 1, {static_cast<uint32_t>(offsetof(EBox, value))}};
+    register_object_layout(box_tag, layout);
+
+    auto box = static_cast<EBox*>(rt_gc_malloc_tagged_object(sizeof(EBox)));
+    box->header.tag = box_tag;
+    box->flags = 0;
+    box->value = rt_make_string("boxed string");
+
+    auto root = rt_make_var(rt_make_symbol("box"));
+    rt_get_gc()->add_object_root(root);
+    rt_set_var(root, OBJECT_TO_TAG(box));
+
+    rt_get_gc()->collect_major(nullptr);
+    rt_get_gc()->collect_major(nullptr);
+
+    box = reinterpret_cast<EBox*>(TAG_TO_OBJECT(rt_deref_var(root)));
+    auto str = reinterpret_cast<EString*>(TAG_TO_OBJECT(box->value));
+    EXPECT_STREQ(str->stringValue, "boxed string");
+
+    rt_deinit_gc();
+}
+
+/** Frame size of the function described by make_stackmap() */
+static const size_t kStackMapFrameSize = 32;
+
+/**
+ * Build a version 3 stackmap for one function with a statepoint every 16
+ * bytes of code. Each statepoint holds one GC pointer, in the stack slot at
+ * pointer_offset, or none if pointer_offset is negative.
+ */
+static std::vector<uint64_t> make_stackmap(uint64_t function_address, uint32_t num_callsites,
+                                           int32_t pointer_offset = -1) {
+    // Each record is a callsite header and 3 constant locations, then a base
+    // and derived location for the pointer, and the liveout header, with
+    // each part padded to 8 bytes
+    const uint16_t num_locations = pointer_offset < 0 ? 3 : 5;
+    const size_t   locations_end = (sizeof(callsite_header_t) + num_locations * sizeof(value_location_t) + 7) & ~7;
+    const size_t   record_size   = (locations_end + sizeof(liveout_header_t) + 7) & ~7;
+    size_t size = sizeof(stackmap_header_t) + sizeof(function_info_t) + num_callsites * record_size;
+    std::vector<uint64_t> buffer((size + 7) / 8, 0);
+    auto bytes = reinterpret_cast<uint8_t*>(buffer.data());
+
+    auto header = reinterpret_cast<stackmap_header_t*>(bytes);
+    header->version = 3;
+    header->numFunctions = 1;
+    header->numRecords = num_callsites;
+
+    auto function = reinterpret_cast<function_info_t*>(header + 1);
+    function->address = function_address;
+    function->stackSize = kStackMapFrameSize;
+    function->callsiteCount = num_callsites;
+
+    auto record = reinterpret_cast<uint8_t*>(function + 1);
+    for (uint32_t i = 0; i < num_callsites; i++, record += record_size) {
+        auto callsite = reinterpret_cast<callsite_header_t*>(record);
+        callsite->codeOffset = i * 16;
+        callsite->numLocations = num_locations;
+
+        auto locations = reinterpret_cast<value_location_t*>(callsite + 1);
+        for (int l = 0; l < 3; l++) {
+            locations[l].kind = Constant;
+        }
+
+        // Relative to the stack pointer, which is DWARF register 7
+        for (int l = 3; l < num_locations; l++) {
+            locations[l].kind = Indirect;
+            locations[l].regNum = 7;
+            locations[l].offset = pointer_offset;
+        }
+    }
+
+    return buffer;
+}
+
+TEST(GC, stackmap_index_finds_call_sites_of_every_module) {
+    StackMapIndex index;
+
+    auto first = make_stackmap(0x10000, 100);
+    auto second = make_stackmap(0x20000, 1000);
+    index.add(first.data());
+    index.add(second.data());
+    index.add(first.data());
+
+    EXPECT_EQ(index.module_count(), 2);
+    EXPECT_EQ(index.size(), 1100);
+    ASSERT_NE(index.lookup(0x10000 + 99 * 16), nullptr);
+    EXPECT_EQ(index.lookup(0x10000 + 99 * 16)->retAddr, 0x10000 + 99 * 16);
+    EXPECT_EQ(index.lookup(0x10000 + 8), nullptr);
+
+    EXPECT_TRUE(index.remove(first.data()));
+    EXPECT_FALSE(index.remove(first.data()));
+    EXPECT_EQ(index.size(), 1000);
+    EXPECT_EQ(index.lookup(0x10000), nullptr);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        ASSERT_NE(index.lookup(0x20000 + i * 16), nullptr);
+    }
+}
+
+TEST_F(GCTest, frames_above_the_stack_maps_are_scanned_conservatively) {
+    auto stackmap = make_stackmap(0x10000, 1, 8);
+    rt_get_gc()->init_stackmap(stackmap.data());
+
+    // A collection from a statepoint in g, which was called from f through
+    // the runtime. g's frame is described by the stack map, and holds a
+    // pointer in its slot. The runtime's return address has no stack map,
+    // and f has a pointer spilled in the frame above it.
+    void* stack[8] = {};
+    auto  g_slot   = 1 + 8 / sizeof(void*);
+    auto  f_slot   = 1 + kStackMapFrameSize / sizeof(void*) + 1;
+
+    stack[0]                = reinterpret_cast<void*>(0x10000);
+    stack[g_slot]           = rt_make_pair(rt_make_integer(1), NIL_PTR);
+    stack[f_slot - 1]       = reinterpret_cast<void*>(0x20000);
+    stack[f_slot]           = rt_make_pair(rt_make_integer(2), rt_make_pair(rt_make_integer(3), NIL_PTR));
+
+    // Kept inverted, so the scan of this frame does not find them
+    auto g_value = ~reinterpret_cast<uintptr_t>(stack[g_slot]);
+    auto f_value = ~reinterpret_cast<uintptr_t>(stack[f_slot]);
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 10000; j++) {
+            rt_make_pair(rt_make_integer(-1), NIL_PTR);
+        }
+        rt_get_gc()->collect_minor(stack);
+
+        // f's value can't be updated, so it stays where it is
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(stack[f_slot]), ~f_value);
+        EXPECT_EQ(rt_integer_value(rt_car(stack[f_slot])), 2);
+        EXPECT_EQ(rt_integer_value(rt_car(rt_cdr(stack[f_slot]))), 3);
+        EXPECT_EQ(rt_integer_value(rt_car(stack[g_slot])), 1);
+    }
+
+    // g's value was relocated precisely
+    EXPECT_NE(reinterpret_cast<uintptr_t>(stack[g_slot]), ~g_value);
+
+    rt_get_gc()->remove_stackmap(stackmap.data());
+}
+
+TEST_F(GCTest, compaction_leaves_objects_referenced_from_unmapped_frames_in_place) {
+    GCConfig config;
+    config.background_sweep = false;
+    restart_gc(config);
+
+    auto stackmap = make_stackmap(0x10000, 1, 8);
+    rt_get_gc()->init_stackmap(stackmap.data());
+
+    auto var = rt_make_var(rt_make_symbol("list"));
+    rt_get_gc()->add_object_root(var);
+
+    auto list = NIL_PTR;
+    for (int i = 0; i < 4000; i++) {
+        list = rt_make_pair(rt_make_integer(i), list);
+    }
+    rt_set_var(var, list);
+    rt_get_gc()->collect_major(nullptr);
+
+    // Keep one pair in ten, so every page is left mostly empty
+    std::vector<void*> survivors;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        survivors.push_back(node);
+
+        auto next = rt_cdr(node);
+        for (int i = 0; i < 9 && next != NIL_PTR; i++) {
+            next = rt_cdr(next);
+        }
+        rt_set_cdr(node, next);
+    }
+
+    // The same layout as above: g's frame has a stack map, f's does not
+    void* stack[8] = {};
+    auto  g_slot   = 1 + 8 / sizeof(void*);
+    auto  f_slot   = 1 + kStackMapFrameSize / sizeof(void*) + 1;
+    auto  g_index  = survivors.size() / 3;
+    auto  f_index  = 2 * survivors.size() / 3;
+
+    stack[0]          = reinterpret_cast<void*>(0x10000);
+    stack[g_slot]     = survivors[g_index];
+    stack[f_slot - 1] = reinterpret_cast<void*>(0x20000);
+    stack[f_slot]     = survivors[f_index];
+
+    rt_get_gc()->collect_major(stack);
+
+    std::vector<void*> nodes;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        nodes.push_back(node);
+    }
+    ASSERT_EQ(nodes.size(), survivors.size());
+
+    size_t moved = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i] != survivors[i]) {
+            moved++;
+        }
+    }
+    EXPECT_GT(moved, survivors.size() / 2);
+
+    // f's object kept its page, and g's slot followed its object if it moved
+    EXPECT_EQ(nodes[f_index], survivors[f_index]);
+    EXPECT_EQ(stack[f_slot], nodes[f_index]);
+    EXPECT_EQ(stack[g_slot], nodes[g_index]);
+    EXPECT_EQ(rt_integer_value(rt_car(stack[f_slot])), 3999 - 10 * static_cast<int64_t>(f_index));
+
+    rt_get_gc()->remove_stackmap(stackmap.data());
+}
+
+/**
+ * Build a list that is only referenced from this frame, and from whatever
+ * registers or stack slots the compiler keeps it in
+ */
+static void* __attribute__((noinline)) make_unrooted_list(int length) {
+    auto list = NIL_PTR;
+    for (int i = 0; i < length; i++) {
+        list = rt_make_pair(rt_make_integer(i), list);
+    }
+    return list;
+}
+
+TEST(GC, conservative_stack_scan_keeps_objects_referenced_from_the_c_stack) {
+    GCConfig config;
+    config.nursery_size = 256 * 1024;
+    config.allocation_budget = 64 * 1024;
+    config.major_collection_threshold = 512 * 1024;
+    config.conservative_stack_scan = true;
+    config.background_sweep = false;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto list = make_unrooted_list(1000);
+    auto str  = reinterpret_cast<EString*>(TAG_TO_OBJECT(rt_make_string("on the stack")));
+
+    // Allocate enough garbage for several minor and major collections,
+    // each started from inside an allocation
+    for (int i = 0; i < 200000; i++) {
+        rt_make_pair(rt_make_integer(i), NIL_PTR);
+        rt_make_string("garbage that ends up in the old generation");
+    }
+    EXPECT_LT(rt_get_gc()->heap_size(), config.nursery_size + 2 * config.major_collection_threshold);
+
+    EXPECT_STREQ(str->stringValue, "on the stack");
+
+    int64_t expected = 999;
+    for (auto node = list; node != NIL_PTR; node = rt_cdr(node)) {
+        ASSERT_EQ(TAG_TO_INTEGER(rt_car(node)), expected);
+        expected--;
+    }
+    EXPECT_EQ(expected, -1);
+
+    rt_deinit_gc();
+}
+
+TEST(GC, threads_allocate_from_their_own_buffers) {
+    GCConfig config;
+    config.nursery_size = 512 * 1024;
+    config.background_sweep = false;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    // Together the threads allocate more than the nursery holds, so some
+    // of them spill into the shared old generation
+    const int num_threads = 4;
+    const int length      = 10000;
+
+    std::vector<void*>       lists(num_threads, NIL_PTR);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&lists, t, length]() {
+          for (int i = 0; i < length; i++) {
+              lists[t] = rt_make_pair(rt_make_integer(t * length + i), lists[t]);
+          }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    std::vector<void*> vars;
+    for (auto list: lists) {
+        auto var = rt_make_var(rt_make_symbol("list"));
+        rt_get_gc()->add_object_root(var);
+        rt_set_var(var, list);
+        vars.push_back(var);
+    }
+
+    rt_get_gc()->collect_major(nullptr);
+
+    for (int t = 0; t < num_threads; t++) {
+        int64_t expected = (t + 1) * length - 1;
+        for (auto node = rt_deref_var(vars[t]); node != NIL_PTR; node = rt_cdr(node)) {
+            ASSERT_EQ(rt_integer_value(rt_car(node)), expected);
+            expected--;
+        }
+        EXPECT_EQ(expected, t * length - 1);
+    }
+
+    rt_deinit_gc();
+}
+
+TEST_F(GCTest, write_barriers_on_several_threads_remember_each_object_once) {
+    GCConfig config;
+    config.background_sweep = false;
+    restart_gc(config);
+
+    // Old pairs shared by every thread
+    const int num_pairs   = 1000;
+    const int num_threads = 4;
+
+    auto var = rt_make_var(rt_make_symbol("pairs"));
+    rt_get_gc()->add_object_root(var);
+
+    auto pairs = NIL_PTR;
+    for (int i = 0; i < num_pairs; i++) {
+        pairs = rt_make_pair(NIL_PTR, pairs);
+    }
+    rt_set_var(var, pairs);
+    rt_get_gc()->collect_major(nullptr);
+
+    std::vector<void*> old_pairs;
+    for (auto node = rt_deref_var(var); node != NIL_PTR; node = rt_cdr(node)) {
+        old_pairs.push_back(node);
+    }
+
+    // Every thread stores young objects into every pair, so the barriers
+    // race to remember the same objects. Some of them fill their
+    // buffers and spill into the old generation.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&old_pairs, t]() {
+          for (int round = 0; round < 10; round++) {
+              for (size_t i = 0; i < old_pairs.size(); i++) {
+                  rt_set_car(old_pairs[i], rt_make_pair(rt_make_integer(static_cast<int64_t>(i)), NIL_PTR));
+              }
+          }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    rt_get_gc()->collect_minor(nullptr);
+    rt_get_gc()->collect_minor(nullptr);
+
+    for (size_t i = 0; i < old_pairs.size(); i++) {
+        auto young = rt_car(old_pairs[i]);
+        ASSERT_EQ(rt_is_pair(young), TRUE_PTR);
+        EXPECT_EQ(rt_integer_value(rt_car(young)), static_cast<int64_t>(i));
+    }
+}
+
+TEST_F(GCTest, only_the_owning_thread_collects) {
+    GCConfig config;
+    config.nursery_size            = 512 * 1024;
+    config.allocation_budget       = 64 * 1024;
+    config.conservative_stack_scan = true;
+    config.background_sweep        = false;
+    restart_gc(config);
+
+    const int num_threads = 4;
+    const int length      = 10000;
+
+    std::vector<void*> vars;
+    for (int t = 0; t < num_threads; t++) {
+        auto var = rt_make_var(rt_make_symbol("list"));
+        rt_get_gc()->add_object_root(var);
+        vars.push_back(var);
+    }
+
+    // The threads spend the budget many times over, but their stacks are
+    // not scanned, so they must not collect
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&vars, t, length]() {
+          auto list = NIL_PTR;
+          for (int i = 0; i < length; i++) {
+              list = rt_make_pair(rt_make_integer(t * length + i), list);
+          }
+          rt_set_var(vars[t], list);
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(rt_get_gc()->stats().minor_collections, 0);
+    EXPECT_EQ(rt_get_gc()->stats().major_collections, 0);
+    EXPECT_TRUE(rt_get_gc()->collection_requested());
+
+    // The owner collects at its next safepoint
+    rt_get_gc()->poll(nullptr);
+    EXPECT_EQ(rt_get_gc()->stats().minor_collections + rt_get_gc()->stats().major_collections, 1);
+
+    for (int t = 0; t < num_threads; t++) {
+        int64_t expected = (t + 1) * length - 1;
+        for (auto node = rt_deref_var(vars[t]); node != NIL_PTR; node = rt_cdr(node)) {
+            ASSERT_EQ(rt_integer_value(rt_car(node)), expected);
+            expected--;
+        }
+        EXPECT_EQ(expected, t * length - 1);
+    }
+}
+
+TEST_F(GCTest, other_threads_read_stats_between_collections) {
+    GCConfig config;
+    config.background_sweep = false;
+    restart_gc(config);
+
+    auto var = rt_make_var(rt_make_symbol("list"));
+    rt_get_gc()->add_object_root(var);
+
+    auto list = NIL_PTR;
+    for (int i = 0; i < 10000; i++) {
+        list = rt_make_pair(rt_make_integer(i), list);
+    }
+    rt_set_var(var, list);
+
+    // Each copy is taken between collections, so the counts never go back
+    // and every major collection follows a minor one
+    std::atomic<bool>        done(false);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&done]() {
+          uint64_t last = 0;
+          while (!done) {
+              GCStats stats;
+              rt_gc_get_stats(&stats);
+
+              auto collections = stats.minor_collections + stats.major_collections;
+              EXPECT_GE(collections, last);
+              EXPECT_GE(stats.minor_collections, stats.major_collections);
+              last = collections;
+          }
+        });
+    }
+
+    for (int i = 0; i < 20; i++) {
+        rt_get_gc()->collect_minor(nullptr);
+        rt_get_gc()->collect_major(nullptr);
+    }
+
+    done = true;
+    for (auto& reader: readers) {
+        reader.join();
+    }
+
+    EXPECT_EQ(rt_get_gc()->copy_stats().major_collections, 20);
+    EXPECT_EQ(rt_get_gc()->copy_stats().minor_collections, 20);
+}
+
+TEST(GC, stats_record_freed_and_live_objects) {
+    GCConfig config;
+    config.background_sweep = false;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto var = rt_make_var(rt_make_symbol("test"));
+    rt_get_gc()->add_object_root(var);
+
+    auto list = NIL_PTR;
+    for (int i = 0; i < 100; i++) {
+        list = rt_make_pair(rt_make_integer(i), list);
+    }
+    rt_set_var(var, list);
+
+    for (int i = 0; i < 1000; i++) {
+        rt_make_pair(rt_make_integer(i), NIL_PTR);
+    }
+
+    rt_get_gc()->collect_minor(nullptr);
+
+    auto& stats = rt_get_gc()->stats();
+    EXPECT_EQ(stats.minor_collections, 1);
+    EXPECT_FALSE(stats.last_collection.major);
+    EXPECT_EQ(stats.last_collection.objects_freed, 1000);
+    EXPECT_EQ(stats.last_collection.bytes_freed, 1000 * align_object_size(sizeof(EPair)));
+
+    // Drop half of the list, now that it is old
+    rt_get_gc()->collect_major(nullptr);
+    auto node = rt_deref_var(var);
+    for (int i = 0; i < 49; i++) {
+        node = rt_cdr(node);
+    }
+    reinterpret_cast<EPair*>(TAG_TO_OBJECT(node))->next = NIL_PTR;
+
+    rt_get_gc()->collect_major(nullptr);
+
+    EXPECT_EQ(stats.major_collections, 2);
+    EXPECT_TRUE(stats.last_collection.major);
+    EXPECT_EQ(stats.last_collection.objects_freed, 50);
+    EXPECT_EQ(stats.last_collection.live_bytes_by_type[kETypeTagPair], 50 * sizeof(EPair));
+    EXPECT_EQ(stats.objects_freed, 1050);
+
+    // The same numbers are available to Lisp, as a property list
+    auto plist = rt_gc_stats();
+    EXPECT_STREQ(rt_keyword_extract_string(rt_car(plist)), "minor-collections");
+    EXPECT_EQ(rt_integer_value(rt_car(rt_cdr(plist))), 1);
+    EXPECT_EQ(rt_integer_value(rt_car(rt_cdr(rt_cdr(rt_cdr(plist))))), 2);
+
+    rt_deinit_gc();
+}
+
+TEST(GC, heap_snapshot_records_objects_and_retained_sizes) {
+    rt_init_gc(kGCModeInterpreterOwned);
+
+    // Long enough for the symbol to be on the heap
+    auto var = rt_make_var(rt_make_symbol("cached-values"));
+    rt_get_gc()->add_object_root(var);
+
+    auto list = NIL_PTR;
+    for (int i = 0; i < 10; i++) {
+        list = rt_make_pair(rt_make_integer(i), list);
+    }
+    rt_set_var(var, list);
+
+    // A diamond: d is reachable through both a and b, so only c dominates it.
+    // The float is too large to be an immediate.
+    auto d = rt_make_pair(rt_make_float(1.5e300), NIL_PTR);
+    auto c = rt_make_pair(d, NIL_PTR);
+    auto a = rt_make_pair(c, NIL_PTR);
+    auto b = rt_make_pair(c, NIL_PTR);
+    auto r = rt_make_pair(a, b);
+    rt_get_gc()->pin(r);
+
+    auto   path        = ::testing::TempDir() + "heap.snapshot";
+    size_t num_objects = 0;
+    ASSERT_TRUE(rt_get_gc()->write_heap_snapshot(path.c_str(), nullptr, &num_objects));
+
+    // The var, its symbol and list, and the diamond with its float
+    EXPECT_EQ(num_objects, 18);
+
+    std::ifstream in(path, std::ios::binary);
+    auto          graph = HeapGraph::read(in);
+    ASSERT_EQ(graph.size(), num_objects);
+
+    DominatorTree tree(graph);
+
+    size_t var_node = kHeapGraphRoot;
+    size_t r_node   = kHeapGraphRoot;
+    for (size_t i = 0; i < graph.size(); i++) {
+        if (graph.node(i).root_kinds == kHeapRootGlobal) {
+            var_node = i;
+        }
+        else if (graph.node(i).root_kinds == kHeapRootPinned) {
+            r_node = i;
+        }
+    }
+    ASSERT_NE(var_node, kHeapGraphRoot);
+    ASSERT_NE(r_node, kHeapGraphRoot);
+
+    auto& var_info = graph.node(var_node);
+    EXPECT_EQ(graph.type_name(var_info.tag), "var");
+    EXPECT_EQ(var_info.num_edges, 2);
+    EXPECT_EQ(graph.node(graph.edge(var_info.first_edge)).label, "cached-values");
+
+    auto symbol_size = graph.node(graph.edge(var_info.first_edge)).size;
+    EXPECT_EQ(tree.retained_size(var_node), sizeof(EVar) + symbol_size + 10 * sizeof(EPair));
+    EXPECT_EQ(tree.retained_size(r_node), 5 * sizeof(EPair) + sizeof(EFloat));
+
+    // Find c and d by following r's first field twice, then c's first field
+    auto a_node = graph.edge(graph.node(r_node).first_edge);
+    auto c_node = graph.edge(graph.node(a_node).first_edge);
+    auto d_node = graph.edge(graph.node(c_node).first_edge);
+    EXPECT_EQ(tree.dominator(a_node), r_node);
+    EXPECT_EQ(tree.dominator(c_node), r_node);
+    EXPECT_EQ(tree.dominator(d_node), c_node);
+    EXPECT_EQ(tree.retained_size(c_node), 2 * sizeof(EPair) + sizeof(EFloat));
+
+    rt_get_gc()->unpin(r);
+    rt_deinit_gc();
+}
+
+/** Stands in for JIT'd code allocating from Lisp */
+static __attribute__((noinline)) void allocate_pairs(int count) {
+    for (int i = 0; i < count; i++) {
+        rt_make_pair(NIL_PTR, NIL_PTR);
+    }
+}
+
+TEST(GC, allocation_profiler_attributes_bytes_to_call_sites) {
+    GCConfig config;
+    config.allocation_sample_interval = 4096;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto start = reinterpret_cast<uint64_t>(&allocate_pairs);
+    rt_gc_register_code("allocate-pairs", start, 256);
+
+    const int count = 10000;
+    allocate_pairs(count);
+
+    auto report = rt_get_gc()->allocation_profiler().report();
+    ASSERT_FALSE(report.empty());
+
+    auto& top = report.front();
+    EXPECT_EQ(top.tag, kETypeTagPair);
+    EXPECT_EQ(top.site.compare(0, 15, "allocate-pairs+"), 0);
+    EXPECT_EQ(top.sampled_bytes, top.samples * sizeof(EPair));
+
+    // Every interval allocated takes one sample, give or take the first and last
+    auto allocated = static_cast<int64_t>(count * align_object_size(sizeof(EPair)));
+    EXPECT_NEAR(static_cast<int64_t>(top.bytes), allocated, 2 * 4096);
+
+    // The same report is available to Lisp
+    auto profile = rt_gc_allocation_profile();
+    auto site    = rt_car(profile);
+    EXPECT_STREQ(rt_keyword_extract_string(rt_car(site)), "site");
+    EXPECT_EQ(std::string(rt_string_value(rt_car(rt_cdr(site)))), top.site);
+
+    rt_gc_stop_allocation_profile();
+    rt_gc_remove_code(start);
+    rt_deinit_gc();
+}
+
+TEST(GC, symbols_and_keywords_are_interned) {
+    GCConfig config;
+    config.background_sweep = false;
+    rt_init_gc(kGCModeInterpreterOwned, config);
+
+    auto sym = rt_make_symbol("name");
+    EXPECT_EQ(rt_make_symbol("name"), sym);
+    EXPECT_NE(rt_make_symbol("other"), sym);
+    EXPECT_NE(rt_make_keyword("name"), sym);
+    EXPECT_EQ(rt_make_keyword("name"), rt_make_keyword("name"));
+
+    // Fill old space pages with names, keeping one alive, so compaction moves it
+    std::vector<std::string> names;
+    for (int i = 0; i < 2000; i++) {
+        names.push_back("symbol-" + std::to_string(i));
+        rt_make_symbol(names.back().c_str());
+    }
+
+    auto var = rt_make_var(rt_make_symbol("symbol-1000"));
+    rt_get_gc()->add_object_root(var);
+
+    auto old_address = reinterpret_cast<EVar*>(TAG_TO_OBJECT(var))->sym;
+    rt_get_gc()->collect_major(nullptr);
+
+    auto kept = reinterpret_cast<EVar*>(TAG_TO_OBJECT(var))->sym;
+    EXPECT_NE(kept, old_address);
+    EXPECT_EQ(rt_make_symbol("symbol-1000"), kept);
+    EXPECT_STREQ(rt_symbol_extract_string(kept), "symbol-1000");
+
+    // Threads interning the same names all get the same objects
+    std::vector<std::vector<void*>> interned(4);
+    std::vector<std::thread>        threads;
+    for (auto& symbols: interned) {
+        threads.emplace_back([&symbols, &names]() {
+          for (auto& name: names) {
+              symbols.push_back(rt_make_symbol(name.c_str()));
+          }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < names.size(); i++) {
+        EXPECT_EQ(interned[0][i], interned[1][i]);
+        EXPECT_EQ(interned[0][i], interned[3][i]);
+        EXPECT_STREQ(rt_symbol_extract_string(interned[2][i]), names[i].c_str());
+    }
+    EXPECT_EQ(interned[0][1000], kept);
+
+    rt_deinit_gc();
+}
+
+TEST(GC, floats_in_range_are_immediates) {
+    rt_init_gc(kGCModeInterpreterOwned);
+
+    const double immediates[] = {0.0, 1.5, -3.25, 1234.5678, 1e-38, -1e38, std::ldexp(1.5, -127), std::ldexp(1.0, 128)};
+    for (auto value: immediates) {
+        auto f = rt_make_float(value);
+        EXPECT_TRUE(is_float_immediate(f)) << value;
+        EXPECT_FALSE(is_object(f));
+        EXPECT_EQ(rt_is_float(f), TRUE_PTR);
+        EXPECT_EQ(rt_float_value(f), value);
+        EXPECT_EQ(std::signbit(rt_float_value(f)), std::signbit(value));
+    }
+
+    // Out of range values keep their exact bits in a box
+    const double boxed[] = {-0.0, 1e300, 1e-300, std::ldexp(1.0, -127), std::ldexp(1.0, 129),
+                            std::numeric_limits<double>::infinity(), std::numeric_limits<double>::denorm_min()};
+    for (auto value: boxed) {
+        auto f = rt_make_float(value);
+        EXPECT_TRUE(is_object_with_tag(f, kETypeTagFloat)) << value;
+        EXPECT_EQ(rt_is_float(f), TRUE_PTR);
+        EXPECT_EQ(rt_float_value(f), value);
+        EXPECT_EQ(std::signbit(rt_float_value(f)), std::signbit(value));
+    }
+
+    auto nan = rt_make_float(std::numeric_limits<double>::quiet_NaN());
+    EXPECT_TRUE(std::isnan(rt_float_value(nan)));
+
+    rt_deinit_gc();
+}
+
+TEST(GC, short_names_and_chars_are_immediates) {
+    rt_init_gc(kGCModeInterpreterOwned);
+
+    auto str = rt_make_string("seven c");
+    EXPECT_FALSE(is_object(str));
+    EXPECT_EQ(rt_is_string(str), TRUE_PTR);
+    EXPECT_STREQ(rt_string_value(str), "seven c");
+    EXPECT_EQ(rt_make_string("seven c"), str);
+    EXPECT_EQ(rt_make_string(""), rt_make_string(""));
+    EXPECT_STREQ(rt_string_value(rt_make_string("")), "");
+
+    // One byte more is boxed
+    auto long_str = rt_make_string("eight ch");
+    EXPECT_TRUE(is_object_with_tag(long_str, kETypeTagString));
+    EXPECT_STREQ(rt_string_value(long_str), "eight ch");
+
+    auto sym     = rt_make_symbol("if");
+    auto keyword = rt_make_keyword("if");
+    EXPECT_EQ(rt_is_symbol(sym), TRUE_PTR);
+    EXPECT_EQ(rt_is_keyword(sym), FALSE_PTR);
+    EXPECT_EQ(rt_is_keyword(keyword), TRUE_PTR);
+    EXPECT_EQ(rt_is_symbol(keyword), FALSE_PTR);
+    EXPECT_EQ(rt_is_string(sym), FALSE_PTR);
+    EXPECT_NE(sym, keyword);
+    EXPECT_NE(rt_make_string("if"), sym);
+    EXPECT_STREQ(rt_symbol_extract_string(sym), "if");
+    EXPECT_STREQ(rt_keyword_extract_string(keyword), "if");
+    EXPECT_EQ(description_for_obj(keyword), ":if");
+
+    auto c = rt_make_char(0x263A);
+    EXPECT_EQ(rt_is_char(c), TRUE_PTR);
+    EXPECT_EQ(rt_is_string(c), FALSE_PTR);
+    EXPECT_EQ(rt_char_value(c), 0x263A);
+    EXPECT_EQ(description_for_obj(c), "#\\\xE2\x98\xBA");
+
+    // Names and chars in fields are not traced, and survive collections unchanged
+    auto pair = rt_make_pair(str, rt_make_pair(sym, rt_make_pair(c, NIL_PTR)));
+    rt_get_gc()->add_object_root(pair);
+    rt_get_gc()->collect_major(nullptr);
+
+    EXPECT_EQ(rt_car(pair), str);
+    EXPECT_EQ(rt_car(rt_cdr(pair)), sym);
+    EXPECT_EQ(rt_car(rt_cdr(rt_cdr(pair))), c);
+
+    // A caller can hold a few decoded names at once, and threads decode
+    // into buffers of their own
+    auto name = rt_symbol_extract_string(sym);
+    EXPECT_STREQ(rt_string_value(rt_make_string("other")), "other");
+    EXPECT_STREQ(rt_keyword_extract_string(keyword), "if");
+    EXPECT_STREQ(name, "if");
+
+    std::thread other([]() {
+      EXPECT_STREQ(rt_string_value(rt_make_string("thread")), "thread");
+    });
+    other.join();
+    EXPECT_STREQ(name, "if");
+
+    EXPECT_EQ(name_string(sym), "if");
+    EXPECT_EQ(name_string(long_str), "eight ch");
+
+    rt_deinit_gc();
+}
+
+TEST_F(GCTest, chars_convert_to_and_from_integers) {
+    auto c = rt_integer_to_char(rt_make_integer(0x263A));
+    EXPECT_EQ(c, rt_make_char(0x263A));
+    EXPECT_EQ(rt_integer_value(rt_char_to_integer(c)), 0x263A);
+
+    // Printed the way the reader reads them
+    EXPECT_EQ(description_for_obj(rt_make_char(' ')), "#\\space");
+    EXPECT_EQ(description_for_obj(rt_make_char('\n')), "#\\newline");
+    EXPECT_EQ(description_for_obj(rt_make_char('a')), "#\\a");
+}
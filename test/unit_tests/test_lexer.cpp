@@ -114,4 +114,15 @@ TEST(Lexer, lexesNil) {
     EXPECT_EQ(tokens.size(), 1);
 
     ASSERT_TOKEN(tokens[0], kTokenTypeNil, "nil");
-}
\ No newline at end of file
+}
+
+TEST(Lexer, lexesChars) {
+    TOKENIZE_STRING("#\\a #\\space #\\\xE2\x98\xBA #\\(");
+
+    EXPECT_EQ(tokens.size(), 4);
+
+    ASSERT_TOKEN(tokens[0], kTokenTypeChar, "#\\a");
+    ASSERT_TOKEN(tokens[1], kTokenTypeChar, "#\\space");
+    ASSERT_TOKEN(tokens[2], kTokenTypeChar, "#\\\xE2\x98\xBA");
+    ASSERT_TOKEN(tokens[3], kTokenTypeChar, "#\\(");
+}
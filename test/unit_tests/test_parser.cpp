@@ -2,6 +2,7 @@
 #include "gtest/gtest.h"
 #include "compiler/Parser.h"
 #include "types/Types.h"
+#include "runtime/Runtime.h"
 
 #define PARSE_STRING(s) Parser p; auto val = p.readString(s , "")
 #define ASSERT_INT(v, intVal) EXPECT_EQ((v)->tag, kTypeTagInteger); EXPECT_EQ((v)->integerValue, intVal)
@@ -161,7 +162,39 @@ TEST(Parser, parsesUnquoteSplice) {
     EXPECT_EQ(*val->listValue->at(1)->stringValue, "a");
 }
 
+TEST(Parser, parsesChar) {
+    PARSE_STRING("(#\\a #\\newline #\\\xE2\x98\xBA)");
+
+    ASSERT_EQ(val->listValue->size(), 3);
+    EXPECT_EQ(val->listValue->at(0)->tag, kTypeTagChar);
+    EXPECT_EQ(val->listValue->at(0)->integerValue, 'a');
+    EXPECT_EQ(val->listValue->at(1)->integerValue, '\n');
+    EXPECT_EQ(val->listValue->at(2)->integerValue, 0x263A);
+}
+
 TEST(Parser, handlesUnterminatedList) {
     Parser p;
     EXPECT_ANY_THROW(p.readString("(", ""));
-}
\ No newline at end of file
+}
+
+TEST(Parser, readsLispChars) {
+    rt_init_gc(kGCModeInterpreterOwned);
+
+    Parser p;
+    auto   position = std::make_shared<SourcePosition>();
+
+    auto c = p.readLispValue(rt_make_char(0x263A), position);
+    EXPECT_EQ(c->tag, kTypeTagChar);
+    EXPECT_EQ(c->integerValue, 0x263A);
+
+    // Chars inside lists, next to immediate names
+    auto list = p.readLispValue(rt_make_pair(rt_make_char('a'), rt_make_pair(rt_make_string("a"), NIL_PTR)), position);
+    ASSERT_EQ(list->tag, kTypeTagList);
+    ASSERT_EQ(list->listValue->size(), 2);
+    EXPECT_EQ(list->listValue->at(0)->tag, kTypeTagChar);
+    EXPECT_EQ(list->listValue->at(0)->integerValue, 'a');
+    EXPECT_EQ(list->listValue->at(1)->tag, kTypeTagString);
+    EXPECT_EQ(*list->listValue->at(1)->stringValue, "a");
+
+    rt_deinit_gc();
+}